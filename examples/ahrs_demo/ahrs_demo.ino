@@ -0,0 +1,54 @@
+//
+// bb_imu orientation (AHRS) example
+// Fuses the accelerometer and gyroscope samples into an orientation
+// and prints the roll/pitch/yaw angles along with the time taken by
+// each filter update. The FIFO (when available) collects the samples
+// between calls, so the loop doesn't have to run at the sample rate.
+//
+#include <bb_imu.h>
+#include <bb_ahrs.h>
+
+BBIMU imu;
+BBAHRS ahrs;
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+#define BATCH_SIZE 32
+
+void setup()
+{
+IMU_FRAME_FORMAT fmt;
+
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  if (imu.init(SDA_PIN, SCL_PIN) != IMU_SUCCESS || !(imu.caps() & IMU_CAP_GYROSCOPE)) {
+    Serial.println("No accelerometer + gyroscope found");
+    while (1) {}
+  }
+  imu.start(200, MODE_ACCEL | MODE_GYRO);
+  if (imu.caps() & IMU_CAP_FIFO) {
+    imu.configFIFO();
+  }
+  imu.getFrameFormat(&fmt, true);
+  ahrs.setGyroScale(fmt.fGyroScale);
+}
+
+void loop()
+{
+IMU_SAMPLE samples[BATCH_SIZE];
+int iCount, iEuler[3];
+unsigned long ulTime;
+
+  iCount = imu.getSamples(samples, BATCH_SIZE);
+  if (iCount > 0) {
+    ulTime = micros();
+    ahrs.updateSamples(samples, iCount);
+    ulTime = micros() - ulTime;
+    ahrs.getEuler(iEuler);
+    Serial.printf("roll %d.%02d pitch %d.%02d yaw %d.%02d (%d samples, %d us/update)\n",
+                  iEuler[0]/100, abs(iEuler[0]%100), iEuler[1]/100, abs(iEuler[1]%100),
+                  iEuler[2]/100, abs(iEuler[2]%100), iCount, (int)(ulTime / iCount));
+  }
+  delay(50);
+}
@@ -0,0 +1,42 @@
+//
+// bb_imu batched sample collection
+// getSamples() drains the FIFO when the sensor has one (or reads the
+// output registers once when it doesn't) and returns timestamped samples,
+// so the same loop works with any supported IMU.
+//
+#include <bb_imu.h>
+
+BBIMU imu;
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+#define BATCH_SIZE 32
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  if (imu.init(SDA_PIN, SCL_PIN) != IMU_SUCCESS) {
+    Serial.println("IMU init failed");
+    while (1) {}
+  }
+  imu.start(100, MODE_ACCEL | MODE_GYRO);
+  if (imu.caps() & IMU_CAP_FIFO) {
+    imu.configFIFO(); // collect samples while we sleep
+  }
+}
+
+void loop()
+{
+IMU_SAMPLE samples[BATCH_SIZE];
+int i, iCount;
+
+  iCount = imu.getSamples(samples, BATCH_SIZE);
+  for (i=0; i<iCount; i++) {
+    Serial.printf("%lu: A: %d, %d, %d  G: %d, %d, %d\n", (unsigned long)samples[i].timestamp,
+                  samples[i].accel[0], samples[i].accel[1], samples[i].accel[2],
+                  samples[i].gyro[0], samples[i].gyro[1], samples[i].gyro[2]);
+  }
+  delay(100); // ~10 samples accumulate in the FIFO between calls
+}
@@ -0,0 +1,49 @@
+//
+// bb_imu BNO055 on-chip fusion example
+// The BNO055 runs its own sensor fusion, so the host only reads the
+// results. The calibration profile is saved once the chip reports that
+// it's fully calibrated; store it (e.g. in EEPROM/flash) and pass it to
+// setCalibProfile() after power-up to skip the calibration dance.
+//
+#include <bb_imu.h>
+
+BBIMU imu;
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+uint8_t ucProfile[IMU_BNO055_PROFILE_LEN];
+bool bSaved = false;
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  if (imu.init(SDA_PIN, SCL_PIN) != IMU_SUCCESS || imu.type() != IMU_TYPE_BNO055) {
+    Serial.println("BNO055 not found");
+    while (1) {}
+  }
+  imu.start(100, MODE_ACCEL | MODE_GYRO | MODE_3DPOS); // NDOF fusion mode
+}
+
+void loop()
+{
+IMU_FUSION fusion;
+int i;
+
+  if (imu.getFusion(&fusion) == IMU_SUCCESS) {
+    Serial.printf("heading %d roll %d pitch %d  lin %d,%d,%d  calib %02x\n",
+                  fusion.euler[0]/16, fusion.euler[1]/16, fusion.euler[2]/16,
+                  fusion.linear[0], fusion.linear[1], fusion.linear[2], fusion.calib);
+    if (!bSaved && fusion.calib == 0xff) { // system, gyro, accel and mag all calibrated
+      imu.getCalibProfile(ucProfile);
+      bSaved = true;
+      Serial.print("profile:");
+      for (i=0; i<IMU_BNO055_PROFILE_LEN; i++) {
+        Serial.printf(" %02x", ucProfile[i]);
+      }
+      Serial.println();
+    }
+  }
+  delay(100);
+}
@@ -0,0 +1,50 @@
+//
+// bb_imu calibration example
+// Measures the accel and gyro offsets while the board lies still and flat,
+// then writes them into the IMU's own offset registers so that every
+// sample (including FIFO data) comes out corrected. The printed bytes can
+// be stored (e.g. in EEPROM/flash) and given to setCalibration() after
+// start() on the next power-up instead of calibrating again.
+//
+#include <bb_imu.h>
+
+BBIMU imu;
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+
+void setup()
+{
+IMU_CALIB calib;
+int i;
+
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  if (imu.init(SDA_PIN, SCL_PIN) != IMU_SUCCESS) {
+    Serial.println("No IMU found");
+    while (1) {}
+  }
+  imu.start(100, MODE_ACCEL | MODE_GYRO);
+  Serial.println("Keep the board flat and still...");
+  delay(1000);
+  if (imu.calibrate(&calib, IMU_FACE_ZUP) != IMU_SUCCESS) {
+    Serial.println("Calibration isn't supported on this IMU");
+    return;
+  }
+  Serial.print("calibration:");
+  for (i=0; i<calib.u8Len; i++) {
+    Serial.printf(" %02x", calib.u8Data[i]);
+  }
+  Serial.println();
+}
+
+void loop()
+{
+IMU_SAMPLE sample;
+
+  imu.getSample(&sample);
+  Serial.printf("acc %d, %d, %d  gyro %d, %d, %d\n", sample.accel[0], sample.accel[1], sample.accel[2],
+                sample.gyro[0], sample.gyro[1], sample.gyro[2]);
+  delay(200);
+}
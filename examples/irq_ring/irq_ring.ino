@@ -0,0 +1,50 @@
+//
+// bb_imu interrupt-driven sample collection
+// The data-ready interrupt only counts events; serviceIRQ() reads the
+// sensor into a ring buffer and popSamples() removes them in batches.
+// On multi-core/RTOS targets serviceIRQ() can run in its own task.
+//
+#include <bb_imu.h>
+
+BBIMU imu;
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+#define INT_PIN 4
+#define RING_SIZE 32 // must be a power of 2
+IMU_SAMPLE ring[RING_SIZE];
+
+void imuISR(void)
+{
+  imu.dataReady();
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  if (imu.init(SDA_PIN, SCL_PIN) != IMU_SUCCESS) {
+    Serial.println("IMU init failed");
+    while (1) {}
+  }
+  imu.start(100, MODE_ACCEL | MODE_GYRO);
+  imu.setRing(ring, RING_SIZE);
+  pinMode(INT_PIN, INPUT);
+  attachInterrupt(digitalPinToInterrupt(INT_PIN), imuISR, RISING);
+  imu.configIRQ(true);
+  imu.getSample(&ring[0]); // clear any pending data-ready condition
+}
+
+void loop()
+{
+IMU_SAMPLE samples[8];
+int i, iCount;
+
+  imu.serviceIRQ(); // read the sensor only when it signaled new data
+  iCount = imu.popSamples(samples, 8);
+  for (i=0; i<iCount; i++) {
+    Serial.printf("A: %d, %d, %d  G: %d, %d, %d\n", samples[i].accel[0], samples[i].accel[1], samples[i].accel[2],
+                  samples[i].gyro[0], samples[i].gyro[1], samples[i].gyro[2]);
+  }
+}
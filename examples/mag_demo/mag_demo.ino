@@ -1,5 +1,7 @@
 //
 // Magnetometer sample gathering
+// Works with the LSM9DS1 (separate mag die) and the BNO055; the mag
+// values are read along with the accelerometer/gyroscope sample
 //
 #include <bb_imu.h>
 BBIMU imu;
@@ -10,8 +12,11 @@ void setup()
    delay(3000); // allow time for CDC-Serial to start
    Serial.println("Starting");
 
-   imu.init();
-   imu.start();
+   if (imu.init() != IMU_SUCCESS || !(imu.caps() & IMU_CAP_MAGNETOMETER)) {
+      Serial.println("No magnetometer found");
+      while (1) {}
+   }
+   imu.start(50, MODE_ACCEL | MODE_GYRO | MODE_MAG);
 }
 
 void loop()
@@ -23,4 +28,3 @@ void loop()
     delay(100);
   }
 }
-
@@ -0,0 +1,55 @@
+//
+// bb_imu multiple IMU example
+// Finds every supported IMU on the bus (e.g. two at 0x68 and 0x69),
+// starts each of them and reads them together through a BBIMUGroup.
+// The group warns when the requested sample rate is more than the
+// bus can carry.
+//
+#include <bb_imu.h>
+#include <bb_imu_group.h>
+
+// Change these depending on your hardware
+#define SDA_PIN -1
+#define SCL_PIN -1
+#define I2C_SPEED 400000
+#define SAMPLE_RATE 200
+#define MAX_IMUS 4
+BBIMU imus[MAX_IMUS];
+BBIMUGroup group;
+
+void setup()
+{
+BBIMU scanner;
+IMU_DEVICE devices[MAX_IMUS];
+int i, iCount;
+
+  Serial.begin(115200);
+  delay(3000); // allow time for CDC-Serial to start
+  Serial.println("Starting");
+  iCount = scanner.scan(devices, MAX_IMUS, SDA_PIN, SCL_PIN, false, I2C_SPEED);
+  for (i=0; i<iCount; i++) {
+    Serial.printf("IMU type %d at 0x%02x\n", devices[i].u8Type, devices[i].u8Addr);
+    imus[i].init(SDA_PIN, SCL_PIN, false, I2C_SPEED, devices[i].u8Type, devices[i].u8Addr);
+    imus[i].start(SAMPLE_RATE, MODE_ACCEL | MODE_GYRO);
+    if (imus[i].caps() & IMU_CAP_FIFO) {
+      imus[i].configFIFO();
+    }
+    group.addDevice(&imus[i], 0, 2000); // all on one bus, up to 2ms of bus time each per pass
+  }
+  Serial.printf("bus load: %d.%d%%\n", group.getBusLoad(0) / 10, group.getBusLoad(0) % 10);
+  if (group.checkLoad() != IMU_SUCCESS) {
+    Serial.println("Warning: the bus can't keep up with this sample rate");
+  }
+}
+
+void loop()
+{
+IMU_SAMPLE samples[32];
+uint8_t ucDevices[32];
+int i, iCount;
+
+  iCount = group.service(samples, ucDevices, 32);
+  for (i=0; i<iCount; i++) {
+    Serial.printf("%d: %d, %d, %d\n", ucDevices[i], samples[i].accel[0], samples[i].accel[1], samples[i].accel[2]);
+  }
+}
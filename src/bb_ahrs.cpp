@@ -0,0 +1,313 @@
+// bb_ahrs.cpp
+// Attitude and heading (AHRS) sensor fusion for bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bb_ahrs.h"
+#include <math.h>
+
+//
+// The same code is built for both number formats through these macros
+//
+#ifdef BB_AHRS_FLOAT
+#define AHRS_Q(f) ((float)(f))
+#define AHRS_MUL(a, b) ((a) * (b))
+#define AHRS_DIV(a, b) ((a) / (b))
+#else
+#define AHRS_FRAC 24
+#define AHRS_Q(f) ((int32_t)((f) * 16777216.0f + (((f) < 0) ? -0.5f : 0.5f)))
+#define AHRS_MUL(a, b) ((int32_t)(((int64_t)(a) * (b) + (1 << (AHRS_FRAC - 1))) >> AHRS_FRAC))
+#define AHRS_DIV(a, b) ((int32_t)(((int64_t)(a) << AHRS_FRAC) / (b)))
+#endif
+#define AHRS_ABS(a) (((a) < 0) ? -(a) : (a))
+#define AHRS_ONE AHRS_Q(1.0f)
+#define AHRS_HALF AHRS_Q(0.5f)
+#define AHRS_PI AHRS_Q(3.14159265f)
+#define AHRS_HALF_PI AHRS_Q(1.57079633f)
+// Longest gap between samples which is integrated; anything longer
+// (e.g. the host slept without the FIFO running) restarts the timing
+#define AHRS_MAX_GAP 250000
+
+#ifndef BB_AHRS_FLOAT
+//
+// Integer square root of a 64-bit value
+//
+static uint32_t ahrsISqrt(uint64_t u64)
+{
+uint64_t u64Result = 0, u64Bit = 1ULL << 62;
+
+    while (u64Bit > u64) u64Bit >>= 2;
+    while (u64Bit != 0) {
+        if (u64 >= u64Result + u64Bit) {
+            u64 -= u64Result + u64Bit;
+            u64Result = (u64Result >> 1) + u64Bit;
+        } else {
+            u64Result >>= 1;
+        }
+        u64Bit >>= 2;
+    }
+    return (uint32_t)u64Result;
+} /* ahrsISqrt() */
+#endif // !BB_AHRS_FLOAT
+
+static ahrs_t ahrsSqrt(ahrs_t x)
+{
+#ifdef BB_AHRS_FLOAT
+    return (x > 0.0f) ? sqrtf(x) : 0.0f;
+#else
+    return (x > 0) ? (ahrs_t)ahrsISqrt((uint64_t)x << AHRS_FRAC) : 0;
+#endif
+} /* ahrsSqrt() */
+
+//
+// Scale a vector to unit length
+//
+static void ahrsNormalize(ahrs_t *v, int iLen)
+{
+ahrs_t sum = 0, norm;
+int i;
+
+    for (i=0; i<iLen; i++) {
+        sum += AHRS_MUL(v[i], v[i]);
+    }
+    norm = ahrsSqrt(sum);
+    if (norm == 0) return;
+    for (i=0; i<iLen; i++) {
+        v[i] = AHRS_DIV(v[i], norm);
+    }
+} /* ahrsNormalize() */
+
+//
+// Convert a raw sensor vector into a unit vector
+// Only the direction is needed, so the sensor scale doesn't matter
+// Returns false for an all-zero vector
+//
+static bool ahrsUnit(const int16_t *pRaw, ahrs_t *pOut)
+{
+int i;
+#ifdef BB_AHRS_FLOAT
+float norm;
+
+    norm = sqrtf((float)pRaw[0]*pRaw[0] + (float)pRaw[1]*pRaw[1] + (float)pRaw[2]*pRaw[2]);
+    if (norm == 0.0f) return false;
+    for (i=0; i<3; i++) {
+        pOut[i] = pRaw[i] / norm;
+    }
+#else
+uint32_t u32Norm;
+
+    u32Norm = ahrsISqrt((uint64_t)((int32_t)pRaw[0]*pRaw[0]) + (uint64_t)((int32_t)pRaw[1]*pRaw[1]) + (uint64_t)((int32_t)pRaw[2]*pRaw[2]));
+    if (u32Norm == 0) return false;
+    for (i=0; i<3; i++) {
+        pOut[i] = (ahrs_t)(((int64_t)pRaw[i] << AHRS_FRAC) / (int64_t)u32Norm);
+    }
+#endif
+    return true;
+} /* ahrsUnit() */
+
+//
+// atan2() in radians; the fixed point version uses the approximation
+// atan(r) = pi/4*r - r*(|r|-1)*(0.2447+0.0663*|r|) (error < 0.0015 rad)
+//
+static ahrs_t ahrsAtan2(ahrs_t y, ahrs_t x)
+{
+#ifdef BB_AHRS_FLOAT
+    return atan2f(y, x);
+#else
+ahrs_t r, ar, a;
+bool bSwap;
+
+    if (x == 0 && y == 0) return 0;
+    bSwap = (AHRS_ABS(y) > AHRS_ABS(x));
+    r = (bSwap) ? AHRS_DIV(x, y) : AHRS_DIV(y, x); // |r| <= 1
+    ar = AHRS_ABS(r);
+    a = AHRS_MUL(AHRS_Q(0.78539816f), r) - AHRS_MUL(AHRS_MUL(r, ar - AHRS_ONE), AHRS_Q(0.2447f) + AHRS_MUL(AHRS_Q(0.0663f), ar));
+    if (bSwap) {
+        a = ((y > 0) ? AHRS_HALF_PI : -AHRS_HALF_PI) - a;
+    } else if (x < 0) {
+        a += (y >= 0) ? AHRS_PI : -AHRS_PI;
+    }
+    return a;
+#endif
+} /* ahrsAtan2() */
+
+//
+// Start over from the level orientation
+//
+void BBAHRS::reset(void)
+{
+    _q[0] = AHRS_ONE;
+    _q[1] = _q[2] = _q[3] = 0;
+    _integral[0] = _integral[1] = _integral[2] = 0;
+    _bStarted = false;
+} /* reset() */
+
+//
+// Set the proportional and integral gains of the filter
+// A higher Kp trusts the accelerometer (and magnetometer) more, Ki removes
+// gyro bias over time (0 = disabled)
+//
+void BBAHRS::setGains(float fKp, float fKi)
+{
+    _twoKp = AHRS_Q(2.0f * fKp);
+    _twoKi = AHRS_Q(2.0f * fKi);
+} /* setGains() */
+
+//
+// Set the gyroscope sensitivity in degrees per second per LSB
+// (e.g. IMU_FRAME_FORMAT.fGyroScale from BBIMU::getFrameFormat())
+//
+void BBAHRS::setGyroScale(float fDPS)
+{
+    _gyroScale = AHRS_Q(fDPS * 0.0174532925f);
+} /* setGyroScale() */
+
+//
+// Advance the orientation by one sample
+// pAcc and pMag can be NULL (gyro only / no heading correction)
+// u32DeltaUs is the time since the previous sample in microseconds
+//
+void BBAHRS::update(const int16_t *pAcc, const int16_t *pGyro, const int16_t *pMag, uint32_t u32DeltaUs)
+{
+ahrs_t a[3], m[3], g[3], e[3], hv[3], hw[3];
+ahrs_t q0, q1, q2, q3, q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+ahrs_t dt, hx, hy, bx, bz;
+int i;
+
+#ifdef BB_AHRS_FLOAT
+    dt = u32DeltaUs * 1e-6f;
+#else
+    dt = (ahrs_t)(((int64_t)u32DeltaUs << AHRS_FRAC) / 1000000);
+#endif
+    for (i=0; i<3; i++) { // rad/s
+        g[i] = (ahrs_t)pGyro[i] * _gyroScale;
+    }
+    q0 = _q[0]; q1 = _q[1]; q2 = _q[2]; q3 = _q[3];
+    if (pAcc != NULL && ahrsUnit(pAcc, a)) {
+        q0q0 = AHRS_MUL(q0, q0); q0q1 = AHRS_MUL(q0, q1); q0q2 = AHRS_MUL(q0, q2);
+        q0q3 = AHRS_MUL(q0, q3); q1q1 = AHRS_MUL(q1, q1); q1q2 = AHRS_MUL(q1, q2);
+        q1q3 = AHRS_MUL(q1, q3); q2q2 = AHRS_MUL(q2, q2); q2q3 = AHRS_MUL(q2, q3);
+        q3q3 = AHRS_MUL(q3, q3);
+        // half of the estimated direction of gravity
+        hv[0] = q1q3 - q0q2;
+        hv[1] = q0q1 + q2q3;
+        hv[2] = q0q0 - AHRS_HALF + q3q3;
+        // error = cross product of the measured and estimated directions
+        e[0] = AHRS_MUL(a[1], hv[2]) - AHRS_MUL(a[2], hv[1]);
+        e[1] = AHRS_MUL(a[2], hv[0]) - AHRS_MUL(a[0], hv[2]);
+        e[2] = AHRS_MUL(a[0], hv[1]) - AHRS_MUL(a[1], hv[0]);
+        if (pMag != NULL && ahrsUnit(pMag, m)) {
+            // reference direction of the earth's magnetic field
+            hx = 2 * (AHRS_MUL(m[0], AHRS_HALF - q2q2 - q3q3) + AHRS_MUL(m[1], q1q2 - q0q3) + AHRS_MUL(m[2], q1q3 + q0q2));
+            hy = 2 * (AHRS_MUL(m[0], q1q2 + q0q3) + AHRS_MUL(m[1], AHRS_HALF - q1q1 - q3q3) + AHRS_MUL(m[2], q2q3 - q0q1));
+            bx = ahrsSqrt(AHRS_MUL(hx, hx) + AHRS_MUL(hy, hy));
+            bz = 2 * (AHRS_MUL(m[0], q1q3 - q0q2) + AHRS_MUL(m[1], q2q3 + q0q1) + AHRS_MUL(m[2], AHRS_HALF - q1q1 - q2q2));
+            // half of the estimated direction of the magnetic field
+            hw[0] = AHRS_MUL(bx, AHRS_HALF - q2q2 - q3q3) + AHRS_MUL(bz, q1q3 - q0q2);
+            hw[1] = AHRS_MUL(bx, q1q2 - q0q3) + AHRS_MUL(bz, q0q1 + q2q3);
+            hw[2] = AHRS_MUL(bx, q0q2 + q1q3) + AHRS_MUL(bz, AHRS_HALF - q1q1 - q2q2);
+            e[0] += AHRS_MUL(m[1], hw[2]) - AHRS_MUL(m[2], hw[1]);
+            e[1] += AHRS_MUL(m[2], hw[0]) - AHRS_MUL(m[0], hw[2]);
+            e[2] += AHRS_MUL(m[0], hw[1]) - AHRS_MUL(m[1], hw[0]);
+        }
+        for (i=0; i<3; i++) { // PI feedback
+            if (_twoKi != 0) {
+                _integral[i] += AHRS_MUL(AHRS_MUL(_twoKi, e[i]), dt);
+                g[i] += _integral[i];
+            }
+            g[i] += AHRS_MUL(_twoKp, e[i]);
+        }
+    }
+    // integrate the rate of change of the quaternion
+    dt = AHRS_MUL(dt, AHRS_HALF);
+    for (i=0; i<3; i++) {
+        g[i] = AHRS_MUL(g[i], dt);
+    }
+    _q[0] += -AHRS_MUL(q1, g[0]) - AHRS_MUL(q2, g[1]) - AHRS_MUL(q3, g[2]);
+    _q[1] += AHRS_MUL(q0, g[0]) + AHRS_MUL(q2, g[2]) - AHRS_MUL(q3, g[1]);
+    _q[2] += AHRS_MUL(q0, g[1]) - AHRS_MUL(q1, g[2]) + AHRS_MUL(q3, g[0]);
+    _q[3] += AHRS_MUL(q0, g[2]) + AHRS_MUL(q1, g[1]) - AHRS_MUL(q2, g[0]);
+    ahrsNormalize(_q, 4);
+} /* update() */
+
+//
+// Run a batch of timestamped samples (e.g. from BBIMU::getSamples())
+// through the filter. The time step comes from the sample timestamps,
+// so a FIFO backlog collected while the host slept catches up correctly.
+// The mag values (MODE_MAG) correct the heading when they're present;
+// they must use the same axes as the accelerometer.
+// Returns the number of samples used
+//
+int BBAHRS::updateSamples(const IMU_SAMPLE *pSamples, int iCount)
+{
+uint32_t u32Delta;
+int i, iUsed = 0;
+
+    for (i=0; i<iCount; i++) {
+        u32Delta = pSamples[i].timestamp - _u32LastTime;
+        _u32LastTime = pSamples[i].timestamp;
+        if (!_bStarted || u32Delta > AHRS_MAX_GAP) { // no usable time step
+            _bStarted = true;
+            continue;
+        }
+        update(pSamples[i].accel, pSamples[i].gyro, pSamples[i].mag, u32Delta);
+        iUsed++;
+    }
+    return iUsed;
+} /* updateSamples() */
+
+//
+// Return the orientation quaternion (w, x, y, z) scaled by 2^30
+//
+void BBAHRS::getQuaternion(int32_t *pQ)
+{
+int i;
+
+    for (i=0; i<4; i++) {
+#ifdef BB_AHRS_FLOAT
+        pQ[i] = (int32_t)(_q[i] * 1073741824.0f);
+#else
+        pQ[i] = _q[i] * (1 << (30 - AHRS_FRAC));
+#endif
+    }
+} /* getQuaternion() */
+
+//
+// Return roll, pitch and yaw in hundredths of a degree
+//
+void BBAHRS::getEuler(int *pEuler)
+{
+ahrs_t q0, q1, q2, q3, s, angle[3];
+int i;
+
+    q0 = _q[0]; q1 = _q[1]; q2 = _q[2]; q3 = _q[3];
+    angle[0] = ahrsAtan2(AHRS_MUL(q0, q1) + AHRS_MUL(q2, q3), AHRS_HALF - AHRS_MUL(q1, q1) - AHRS_MUL(q2, q2));
+    s = 2 * (AHRS_MUL(q0, q2) - AHRS_MUL(q1, q3));
+    if (s > AHRS_ONE) s = AHRS_ONE;
+    else if (s < -AHRS_ONE) s = -AHRS_ONE;
+    angle[1] = ahrsAtan2(s, ahrsSqrt(AHRS_ONE - AHRS_MUL(s, s))); // asin()
+    angle[2] = ahrsAtan2(AHRS_MUL(q1, q2) + AHRS_MUL(q0, q3), AHRS_HALF - AHRS_MUL(q2, q2) - AHRS_MUL(q3, q3));
+    for (i=0; i<3; i++) {
+#ifdef BB_AHRS_FLOAT
+        pEuler[i] = (int)(angle[i] * 5729.578f);
+#else
+        pEuler[i] = (int)((((int64_t)angle[i] * 572958) >> AHRS_FRAC) / 100);
+#endif
+    }
+} /* getEuler() */
@@ -0,0 +1,61 @@
+// bb_ahrs.h
+// Attitude and heading (AHRS) sensor fusion for bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bb_imu.h"
+
+#ifndef __BB_AHRS__
+#define __BB_AHRS__
+
+//
+// Mahony complementary filter (gyro integration corrected by the
+// gravity and magnetic field directions) producing a quaternion
+// The math is done in Q8.24 fixed point so that it runs on MCUs without
+// an FPU; define BB_AHRS_FLOAT (for every file) to build it with floats
+//
+#ifdef BB_AHRS_FLOAT
+typedef float ahrs_t;
+#else
+typedef int32_t ahrs_t; // Q8.24
+#endif
+
+class BBAHRS
+{
+public:
+    BBAHRS() {_gyroScale = 0; setGains(0.5f, 0.0f); reset(); }
+    ~BBAHRS() {}
+
+    void reset(void);
+    void setGains(float fKp, float fKi);
+    void setGyroScale(float fDPS);
+    void update(const int16_t *pAcc, const int16_t *pGyro, const int16_t *pMag, uint32_t u32DeltaUs);
+    int updateSamples(const IMU_SAMPLE *pSamples, int iCount);
+    void getQuaternion(int32_t *pQ);
+    void getEuler(int *pEuler);
+
+private:
+    ahrs_t _q[4]; // w, x, y, z
+    ahrs_t _integral[3]; // integral feedback (Ki)
+    ahrs_t _twoKp, _twoKi;
+    ahrs_t _gyroScale; // radians per second per LSB
+    uint32_t _u32LastTime; // timestamp of the last sample
+    bool _bStarted;
+}; // class BBAHRS
+#endif // __BB_AHRS__
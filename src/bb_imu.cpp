@@ -21,446 +21,2317 @@
 
 #include "bb_imu.h"
 #include "BMI270_config.inl"
+// SIMD versions of the frame decode kernels (decodeFrames(), convertFrames())
+// on hosts with SSE2 or NEON; define IMU_NO_SIMD to use the plain C ones
+#ifndef IMU_NO_SIMD
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define IMU_SSE2
+#elif defined(__ARM_NEON) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#include <arm_neon.h>
+#define IMU_NEON
+#endif
+#endif // !IMU_NO_SIMD
 
 int16_t bmi270_rates[] = {0, 1, 2, 3, 6, 12, 25, 50, 100, 200, 400, 800, 1600, 3200, 6400, 12800, -1};
 int16_t lis3dsh_rates[] = {0, 3, 6, 12, 25, 50, 100, 400, 800, 1600, -1};
+int16_t lis3dh_rates[] = {0, 1, 10, 25, 50, 100, 200, 400, 1344, -1};
+int16_t adxl345_rates[] = {0, 6, 12, 25, 50, 100, 200, 400, 800, 1600, 3200, -1};
 int16_t lsm6ds3_rates[] = {0, 12, 26, 52, 104, 208, 416, 833, 1660, 3330, 6660, -1};
 int16_t lsm9ds1_accel_rates[] = {0, 10, 50, 119, 238, 476, 952, -1};
 int16_t lsm9ds1_gyro_rates[] = {0, 15, 60, 119, 238, 476, 952, -1};
 const int16_t mpu6050_rates[] = {0, 3, 7, 15, 31, 62, 125, 250, 500, 1000, 2000, 4000, 8000, -1}; 
 const int16_t qmi8658_accel_rates[] = {31, 62, 125, 250, 500, 1000, -1};
 const int16_t qmi8658_gyro_rates[] = {29, 58, 117, 235, 470, 940, 1880, 3760, 7520, -1};
+int16_t qmi8658_ae_rates[] = {0, 1, 2, 4, 8, 16, 32, 64, -1}; // AttitudeEngine
 // The order is not linear: 2, 16, 4, 8
 const uint8_t lsm6ds3_scales[4] = {0,2,3,1};
-const uint8_t lis3dsh_scales[4] = {0,1,2,4};
+// FSCALE 2 is +/-6g, so 8g is code 3
+const uint8_t lis3dsh_scales[4] = {0,1,3,4};
 const uint8_t bmi160_scales[4] = {3,5,8,12};
+//
+// Register layout and capabilities of each supported device
+// in the order in which they are detected
+//
+typedef struct _tagimudesc
+{
+   uint8_t u8Type;
+   uint8_t u8Addr; // default address (+1 = alternate address)
+   uint8_t u8IDReg, u8ID, u8ID2; // ID register and the values it can hold
+   uint8_t bBigEndian;
+   uint8_t u8Status, u8Acc, u8Gyro, u8Temp, u8TempLen, u8Mag, u8Step; // starting registers
+   uint8_t u8AccReady, u8GyroReady; // new data bits of the status register
+   uint8_t u8Time; // 24-bit sensortime register (39.0625us ticks)
+   uint8_t u8Quat, u8QuatLen; // quaternion (+ velocity increments) with MODE_3DPOS
+   uint8_t u8Caps;
+   float fGyroScale; // dps per LSB at the gyro range start() selects
+} IMU_DESC;
+
+static constexpr IMU_DESC imu_devices[] = {
+   {IMU_TYPE_QMI8658, IMU_QMI8658_ADDR, 0x00, 0x05, 0x05, false, 0x2e, 0x35, 0x3b, 0x33, 2, 0, 0, 0x01, 0x02, 0, 0x49, 14,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_3DPOS, 1.0f/256.0f},
+   {IMU_TYPE_BNO055, IMU_BNO055_ADDR, 0x00, 0xa0, 0xa0, false, 0, 0x08, 0x14, 0x34, 1, 0x0e, 0, 0, 0, 0, 0x20, 8,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_MAGNETOMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_3DPOS, 1.0f/16.0f},
+   {IMU_TYPE_BMI270, IMU_BMI270_ADDR, 0x00, 0x24, 0x24, false, 0x03, 0x0c, 0x12, 0x22, 2, 0, 0, 0x80, 0x40, 0x18, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 1.0f/16.4f},
+   {IMU_TYPE_LSM9DS1, IMU_LSM9DS1_ADDR, 0x0f, 0x68, 0x68, false, 0x17, 0x28, 0x18, 0x15, 2, 0, 0, 0x01, 0, 0, 0, 0, // start() only powers the accelerometer (and the mag die)
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_MAGNETOMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 0.00875f},
+   {IMU_TYPE_LSM6DS3, IMU_LSM6DS3_ADDR, 0x0f, 0x69, 0x6a, false, 0x1e, 0x28, 0x22, 0x20, 2, 0, 0x4b, 0x01, 0x02, 0, 0, 0, // normal or "C" variant
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 0.00875f},
+   {IMU_TYPE_LIS3DH, IMU_LIS3DH_ADDR, 0x0f, 0x33, 0x33, false, 0x27, 0x28, 0, 0x0c, 1, 0, 0, 0x08, 0, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 0.0f},
+   {IMU_TYPE_LIS3DSH, IMU_LIS3DSH_ADDR, 0x0f, 0x3f, 0x3f, false, 0x27, 0x28, 0, 0x0c, 1, 0, 0, 0x08, 0, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 0.0f},
+   {IMU_TYPE_ADXL345, IMU_ADXL345_ADDR, 0x00, 0xe5, 0xe5, false, 0x30, 0x32, 0, 0, 0, 0, 0, 0x80, 0, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO, 0.0f},
+   {IMU_TYPE_BMI160, IMU_BMI160_ADDR, 0x00, 0xd1, 0xd1, false, 0x1b, 0x12, 0x0c, 0x20, 2, 0, 0x78, 0x80, 0x40, 0x18, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_PEDOMETER, 1.0f/16.4f},
+   {IMU_TYPE_MPU6050, IMU_MPU6050_ADDR, 0x75, 0x68, 0x68, true, 0x3a, 0x3b, 0x43, 0x41, 2, 0, 0, 0x01, 0x01, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 1.0f/131.0f},
+   {IMU_TYPE_MPU6500, IMU_MPU6050_ADDR, 0x75, 0x70, 0x70, true, 0x3a, 0x3b, 0x43, 0x41, 2, 0, 0, 0x01, 0x01, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 1.0f/131.0f},
+   {IMU_TYPE_MPU6886, IMU_MPU6886_ADDR, 0x75, 0x19, 0x19, true, 0x3a, 0x3b, 0x43, 0x41, 2, 0, 0, 0x01, 0x01, 0, 0, 0,
+    IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE, 1.0f/16.4f},
+};
+#define IMU_DEVICE_COUNT (int)(sizeof(imu_devices) / sizeof(IMU_DESC))
+// Unused registers between two values which are still cheaper to read
+// than starting a new transaction (start, address, register, restart, address)
+#define IMU_READ_GAP 6
+// BNO055 non-fusion mode for each combination of acc (1), mag (2) and gyro (4)
+static const uint8_t bno055_modes[8] = {BNO055_MODE_ACCGYRO, BNO055_MODE_ACCONLY, BNO055_MODE_MAGONLY, BNO055_MODE_ACCMAG,
+   BNO055_MODE_GYRONLY, BNO055_MODE_ACCGYRO, BNO055_MODE_MAGGYRO, BNO055_MODE_AMG};
+// Offset registers: start register and length of each span, 0 terminated
+static const uint8_t mpu6050_offset_regs[] = {0x06, 6, 0x13, 6, 0}; // XA_OFFS_H, XG_OFFS_USRH
+static const uint8_t mpu6500_offset_regs[] = {0x77, 2, 0x7a, 2, 0x7d, 2, 0x13, 6, 0}; // XA/YA/ZA_OFFSET_H, XG_OFFSET_H
+static const uint8_t bmi_offset_regs[] = {0x71, 7, 0}; // OFFSET_0..6
+static const uint8_t lsm6ds3_offset_regs[] = {0x73, 3, 0}; // X/Y/Z_OFS_USR
+// LSM9DS1 magnetometer die (its own I2C address)
+#define LSM9DS1_MAG_ADDR 0x1c
+#define LSM9DS1_MAG_ID 0x3d
+// Bytes getSample() can read for a device: every value planReads() can
+// include (acc/gyro/mag 6, temp, steps 2, status 1, time 3, quat) with a
+// gap of up to IMU_READ_GAP between each, plus the 6 bytes read from a
+// separate magnetometer die (LSM9DS1); IMU_PLAN_SIZE is the largest in
+// the table (53, the QMI8658), so it follows the table when it changes
+static constexpr int imuPlanValues(const IMU_DESC &d)
+{
+    return ((d.u8Caps & IMU_CAP_ACCELEROMETER) ? 1 : 0) + ((d.u8Caps & IMU_CAP_GYROSCOPE) ? 1 : 0) + (d.u8Mag ? 1 : 0) +
+           ((d.u8Caps & IMU_CAP_TEMPERATURE) ? 1 : 0) + ((d.u8Caps & IMU_CAP_PEDOMETER) ? 1 : 0) + (d.u8Status ? 1 : 0) +
+           (d.u8Time ? 1 : 0) + (d.u8Quat ? 1 : 0);
+} /* imuPlanValues() */
+
+static constexpr int imuPlanBytes(const IMU_DESC &d)
+{
+    return ((d.u8Caps & IMU_CAP_ACCELEROMETER) ? 6 : 0) + ((d.u8Caps & IMU_CAP_GYROSCOPE) ? 6 : 0) + (d.u8Mag ? 6 : 0) +
+           ((d.u8Caps & IMU_CAP_TEMPERATURE) ? d.u8TempLen : 0) + ((d.u8Caps & IMU_CAP_PEDOMETER) ? 2 : 0) + (d.u8Status ? 1 : 0) +
+           (d.u8Time ? 3 : 0) + (d.u8Quat ? d.u8QuatLen : 0) +
+           ((imuPlanValues(d) > 1) ? (imuPlanValues(d) - 1) * IMU_READ_GAP : 0) +
+           (((d.u8Caps & IMU_CAP_MAGNETOMETER) && !d.u8Mag) ? 6 : 0);
+} /* imuPlanBytes() */
+
+static constexpr int imuLarger(int a, int b)
+{
+    return (a > b) ? a : b;
+} /* imuLarger() */
+
+static constexpr int imuPlanSize(int i)
+{
+    return (i >= IMU_DEVICE_COUNT) ? 0 : imuLarger(imuPlanBytes(imu_devices[i]), imuPlanSize(i + 1));
+} /* imuPlanSize() */
+#define IMU_PLAN_SIZE imuPlanSize(0)
+// Bits on the wire for a register read besides the data: start, address,
+// register, restart, address, stop (9 bits per byte with the ACK)
+#define IMU_I2C_OVERHEAD 38
+
+#ifdef BB_IMU_STATS
+//
+// Count a transaction and pass its result through
+//
+int BBIMU::statsI2C(int rc, int iBytes)
+{
+    _stats.u32Transactions++;
+    _stats.u32Bytes += iBytes;
+    if (!rc) _stats.u32Errors++;
+    return rc;
+} /* statsI2C() */
+// Count every transaction made by the member functions below
+#define I2CReadRegister(pI2C, iAddr, ucReg, pData, iLen) statsI2C(I2CReadRegister(pI2C, iAddr, ucReg, pData, iLen), 3 + (iLen))
+#define I2CWrite(pI2C, iAddr, pData, iLen) statsI2C(I2CWrite(pI2C, iAddr, pData, iLen), 1 + (iLen))
+#define IMU_STATS_ADD(field, n) _stats.field += (n)
+#define IMU_STATS_TIME(call) imu_stats_timer statsTimer(&_stats, call)
+//
+// Adds the time spent in a call to its histogram when it goes out of scope
+//
+struct imu_stats_timer
+{
+    IMU_STATS *pStats;
+    int iCall;
+    uint32_t u32Start;
+    imu_stats_timer(IMU_STATS *p, int i) { pStats = p; iCall = i; u32Start = micros(); }
+    ~imu_stats_timer() {
+        uint32_t u32 = (micros() - u32Start) >> 6; // 64us units
+        int n = 0;
+        while (u32 != 0 && n < IMU_STATS_BUCKETS - 1) { u32 >>= 1; n++; }
+        pStats->u32Latency[iCall][n]++;
+    }
+};
+#else
+#define IMU_STATS_ADD(field, n)
+#define IMU_STATS_TIME(call)
+#endif
+// Length (ms) of the window over which the chip clock is measured
+#define IMU_CLOCK_WINDOW 60000UL
+
 BBI2C * BBIMU::getBB(void)
 {
-   return &_bbi2c;
-} /* getBB() */
+   return &_bbi2c;
+} /* getBB() */
+//
+// Look for supported devices on the bus, in the order of the device
+// table (first address of every device, then the alternate ones)
+// Each address is probed once and each distinct ID register is read once.
+// If the type and/or address are known (iType/iAddr), only matching
+// entries are tried; with both given, the bus isn't probed at all.
+// Only the first device identified at each address is reported.
+// Returns the number of devices stored in pList (up to iMax)
+//
+int BBIMU::probe(int iType, int iAddr, IMU_DEVICE *pList, int iMax)
+{
+// every device has 2 addresses and one ID register at each of them
+uint8_t ucAddrs[IMU_DEVICE_COUNT * 2], ucPresent[IMU_DEVICE_COUNT * 2]; // probe cache
+uint8_t ucIDAddr[IMU_DEVICE_COUNT * 2], ucIDReg[IMU_DEVICE_COUNT * 2], ucIDVal[IMU_DEVICE_COUNT * 2]; // ID register cache
+int i, j, iOffset, iAddrCount, iIDCount, iFound;
+const IMU_DESC *pDesc;
+
+    iFound = iAddrCount = iIDCount = 0;
+    for (iOffset = 0; iOffset<2 && iFound < iMax; iOffset++) { // try both addresses of each device
+        for (i=0; i<IMU_DEVICE_COUNT && iFound < iMax; i++) {
+            pDesc = &imu_devices[i];
+            if ((iType != IMU_TYPE_UNDEFINED && pDesc->u8Type != iType) ||
+                (iAddr >= 0 && pDesc->u8Addr + iOffset != iAddr)) {
+                continue;
+            }
+            if (iType != IMU_TYPE_UNDEFINED && iAddr >= 0) { // trust the caller
+                pList[iFound].u8Type = pDesc->u8Type;
+                pList[iFound++].u8Addr = (uint8_t)iAddr;
+                break;
+            }
+            for (j=0; j<iFound && pList[j].u8Addr != pDesc->u8Addr + iOffset; j++) {}
+            if (j < iFound) continue; // already identified
+            // probe the I2C bus for devices
+            for (j=0; j<iAddrCount && ucAddrs[j] != pDesc->u8Addr + iOffset; j++) {}
+            if (j == iAddrCount) {
+                ucAddrs[j] = pDesc->u8Addr + iOffset;
+                ucPresent[j] = I2CTest(&_bbi2c, ucAddrs[j]);
+                iAddrCount++;
+            }
+            if (!ucPresent[j]) continue;
+            // try to read the "WHO_AM_I" / "CHIP_ID" register
+            for (j=0; j<iIDCount && (ucIDAddr[j] != pDesc->u8Addr + iOffset || ucIDReg[j] != pDesc->u8IDReg); j++) {}
+            if (j == iIDCount) {
+                ucIDAddr[j] = pDesc->u8Addr + iOffset;
+                ucIDReg[j] = pDesc->u8IDReg;
+                ucIDVal[j] = 0;
+                I2CReadRegister(&_bbi2c, ucIDAddr[j], ucIDReg[j], &ucIDVal[j], 1);
+                iIDCount++;
+            }
+            if (ucIDVal[j] == pDesc->u8ID || ucIDVal[j] == pDesc->u8ID2) {
+                pList[iFound].u8Type = pDesc->u8Type;
+                pList[iFound++].u8Addr = ucIDAddr[j];
+            }
+        } // for each device
+    } // for each address offset
+    return iFound;
+} /* probe() */
+
+//
+// Initialize the I2C interface and return every supported device
+// found on the bus, so that one BBIMU can be started for each of them
+// with init(iSDA, iSCL, bBitBang, u32Speed, pList[i].u8Type, pList[i].u8Addr)
+// Returns the number of devices stored in pList (up to iMaxDevices)
+//
+int BBIMU::scan(IMU_DEVICE *pList, int iMaxDevices, int iSDA, int iSCL, bool bBitBang, uint32_t u32Speed)
+{
+    _bbi2c.iSDA = iSDA;
+    _bbi2c.iSCL = iSCL;
+    _bbi2c.bWire = !bBitBang;
+    I2CInit(&_bbi2c, u32Speed);
+    return probe(IMU_TYPE_UNDEFINED, -1, pList, iMaxDevices);
+} /* scan() */
+
+//
+// Initialize the I2C interface and detect the chip type
+// (the first supported device found, see probe())
+//
+int BBIMU::init(int iSDA, int iSCL, bool bBitBang, uint32_t u32Speed, int iType, int iAddr)
+{
+uint8_t ucTemp[4];
+IMU_DEVICE dev;
+int i;
+const IMU_DESC *pFound;
+
+    _bbi2c.iSDA = iSDA;
+    _bbi2c.iSCL = iSCL;
+    _bbi2c.bWire = !bBitBang;
+    _u32Speed = u32Speed;
+    I2CInit(&_bbi2c, u32Speed);
+
+    if (probe(iType, iAddr, &dev, 1) != 1) {
+        return IMU_ERROR;
+    }
+    for (i=0; imu_devices[i].u8Type != dev.u8Type; i++) {}
+    pFound = &imu_devices[i];
+    _iType = pFound->u8Type;
+    _iAddr = dev.u8Addr;
+    _bBigEndian = pFound->bBigEndian;
+    _iStatus = pFound->u8Status;
+    _ucAccReady = pFound->u8AccReady;
+    _ucGyroReady = pFound->u8GyroReady;
+    _iTimeStart = pFound->u8Time;
+    _iQuatStart = pFound->u8Quat;
+    _iQuatLen = pFound->u8QuatLen;
+    _fGyroScale = pFound->fGyroScale;
+    _iAccStart = pFound->u8Acc;
+    _iGyroStart = pFound->u8Gyro;
+    _iTempStart = pFound->u8Temp;
+    _iTempLen = pFound->u8TempLen;
+    _iMagStart = pFound->u8Mag;
+    _iStepStart = pFound->u8Step;
+    _u32Caps = pFound->u8Caps;
+    _iMagAddr = 0;
+    if (_iType == IMU_TYPE_LSM9DS1) { // the magnetometer is a separate die
+        for (i=0; i<2 && _iMagAddr == 0; i++) { // SDO_M selects 0x1C or 0x1E
+            ucTemp[0] = 0;
+            I2CReadRegister(&_bbi2c, LSM9DS1_MAG_ADDR + i*2, 0x0f, ucTemp, 1); // WHO_AM_I_M
+            if (ucTemp[0] == LSM9DS1_MAG_ID) _iMagAddr = LSM9DS1_MAG_ADDR + i*2;
+        }
+        if (_iMagAddr == 0) _u32Caps &= ~IMU_CAP_MAGNETOMETER;
+    }
+    if (_iType == IMU_TYPE_QMI8658) {
+        ucTemp[0] = 2; // CTRL1
+        ucTemp[1] = 0x40; // enable auto-increment of addresses
+        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    }
+    return IMU_SUCCESS;
+} /* init() */
+//
+// Read a block of registers in as few transactions as the I2C
+// transport allows. FIFO output registers either don't auto-increment
+// or wrap back to their start, so each chunk re-reads from the same
+// register address and the FIFO keeps popping entries.
+// Chunks are kept to a multiple of iUnit bytes so that a new
+// transaction never starts in the middle of a FIFO entry.
+//
+int BBIMU::readBurst(uint8_t ucReg, uint8_t *pData, int iLen, int iUnit)
+{
+int iChunk, iMax;
+
+    iMax = (IMU_MAX_I2C_READ / iUnit) * iUnit;
+    if (iMax == 0) iMax = IMU_MAX_I2C_READ;
+    while (iLen > 0) {
+        iChunk = (iLen > iMax) ? iMax : iLen;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, ucReg, pData, iChunk)) {
+            return IMU_ERROR;
+        }
+        pData += iChunk;
+        iLen -= iChunk;
+    }
+    return IMU_SUCCESS;
+} /* readBurst() */
+
+//
+// Decode a block of BMI160/BMI270 headered FIFO frames
+// Samples are written as gyro X/Y/Z followed by accel X/Y/Z (only the
+// sensors enabled in iMode), the same layout as the LSM6DS3 FIFO.
+// A frame which is cut off at the end of the buffer is left unconsumed
+// because the sensor repeats a partially read frame on the next read;
+// so are the frames past iMaxSamples (*piUsed tells where it stopped).
+// No bus access happens here, so it can be fed captured FIFO data.
+//
+int BBIMU::parseBMIFIFO(int iType, int iMode, const uint8_t *pFIFO, int iLen, int16_t *pSamples, int iMaxSamples, IMU_FIFO_INFO *pInfo, int *piUsed)
+{
+const uint8_t *s, *p, *pEnd;
+uint8_t ucHeader, ucNeed;
+int i, iCount, iFrameLen;
+
+    s = pFIFO;
+    pEnd = &pFIFO[iLen];
+    iCount = 0;
+    ucNeed = 0; // sensors which must be present in a frame to produce a sample
+    if (iMode & MODE_GYRO) ucNeed |= 0x08;
+    if (iMode & MODE_ACCEL) ucNeed |= 0x04;
+    while (s < pEnd) {
+        ucHeader = s[0] & 0xfc; // lower 2 bits are interrupt tags
+        if ((ucHeader & 0xc0) == 0x80) { // regular (sensor data) frame
+            if (ucHeader == 0x80) break; // over-read marker, FIFO is empty
+            iFrameLen = 1;
+            if (ucHeader & 0x10) iFrameLen += 8; // aux (magnetometer)
+            if (ucHeader & 0x08) iFrameLen += 6; // gyroscope
+            if (ucHeader & 0x04) iFrameLen += 6; // accelerometer
+            if (s + iFrameLen > pEnd) break; // partial frame
+            if (ucNeed != 0 && (ucHeader & ucNeed) == ucNeed) {
+                if (iCount >= iMaxSamples) break;
+                p = &s[1];
+                if (ucHeader & 0x10) p += 8; // skip aux data
+                if (ucHeader & 0x08) { // gyroscope comes before accelerometer
+                    if (iMode & MODE_GYRO) {
+                        for (i=0; i<3; i++) {
+                            *pSamples++ = (int16_t)(p[i*2] | (p[i*2+1] << 8));
+                        }
+                    }
+                    p += 6;
+                }
+                if ((ucHeader & 0x04) && (iMode & MODE_ACCEL)) {
+                    for (i=0; i<3; i++) {
+                        *pSamples++ = (int16_t)(p[i*2] | (p[i*2+1] << 8));
+                    }
+                }
+                iCount++;
+            } else if (ucNeed != 0) { // frame is missing an enabled sensor
+                pInfo->iLost++;
+            }
+        } else if (ucHeader == 0x40) { // skip frame (FIFO overflowed)
+            iFrameLen = 2;
+            if (s + iFrameLen > pEnd) break;
+            pInfo->iLost += s[1]; // number of skipped frames
+        } else if (ucHeader == 0x44) { // sensortime frame
+            iFrameLen = 4;
+            if (s + iFrameLen > pEnd) break;
+            pInfo->u32SensorTime = s[1] | (s[2] << 8) | ((uint32_t)s[3] << 16);
+        } else if (ucHeader == 0x48) { // input config changed
+            iFrameLen = (iType == IMU_TYPE_BMI270) ? 5 : 2;
+            if (s + iFrameLen > pEnd) break;
+            pInfo->iConfigChanges++;
+        } else { // unknown header; drop the rest and resync on the next read
+            pInfo->iLost++; // at least this frame
+            s = pEnd;
+            break;
+        }
+        s += iFrameLen;
+    }
+    *piUsed = (int)(s - pFIFO);
+    return iCount;
+} /* parseBMIFIFO() */
+
+//
+// Return the information collected while draining the FIFO
+//
+void BBIMU::getFIFOInfo(IMU_FIFO_INFO *pInfo)
+{
+    memcpy(pInfo, &_fifoInfo, sizeof(IMU_FIFO_INFO));
+} /* getFIFOInfo() */
+
+//
+// Return the time spent in each phase of the last start()
+//
+void BBIMU::getStartupInfo(IMU_STARTUP_INFO *pInfo)
+{
+    memcpy(pInfo, &_startupInfo, sizeof(IMU_STARTUP_INFO));
+} /* getStartupInfo() */
+
+//
+// Read the samples queued in the FIFO
+// Each sample is written as gyro X/Y/Z followed by accel X/Y/Z
+// (depending on which sensors are enabled)
+//
+int BBIMU::getQueuedSamples(int16_t *pSamples, int *iNumSamples, int iMaxSamples)
+{
+uint8_t ucTemp[4];
+int iNum, iCount;
+
+    IMU_STATS_TIME(IMU_CALL_QUEUED);
+    *iNumSamples = 0;
+    if (_iType == IMU_TYPE_LSM6DS3) {
+        // read the FIFO status
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x3a, ucTemp, 4))
+        {
+            return IMU_ERROR;
+        }
+        if (ucTemp[1] & 0x40) { // FIFO_OVER - the continuous mode overwrote unread data
+            _fifoInfo.iLost++;
+            IMU_STATS_ADD(u32Overflows, 1);
+            IMU_STATS_ADD(u32Dropped, 1);
+        }
+//        if (ucTemp[1] & 0x10) { // FIFO is empty
+//            *iNumSamples = 0;
+//            return MT_SUCCESS;
+//        }
+        iNum = ucTemp[0] + ((ucTemp[1] & 0xf) << 8); // number of unread 16-bit axis in FIFO (12 bits)
+        iCount = 0;
+        if (_iMode & MODE_ACCEL) iCount += 3;
+        if (_iMode & MODE_GYRO) iCount += 3;
+        if (iNum == 0 || iCount == 0) {
+            *iNumSamples = 0;
+            return IMU_SUCCESS;
+        }
+        if ((iNum / iCount) > iMaxSamples) {
+            iNum = iCount * iMaxSamples;
+        }
+        iNum -= (iNum % iCount); // only read complete samples
+        // FIFO_DATA_OUT_L/H (0x3E/0x3F) wraps back to 0x3E on auto-increment, so
+        // the whole level can be burst-read straight into the caller's buffer
+        // (the data is little-endian, same as the MCU)
+        if (readBurst(0x3e, (uint8_t *)pSamples, iNum * 2, 2) != IMU_SUCCESS) {
+            return IMU_ERROR;
+        }
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for (int i=0; i<iNum; i++) {
+            pSamples[i] = (int16_t)__builtin_bswap16((uint16_t)pSamples[i]);
+        }
+#endif
+        *iNumSamples = iNum / iCount;
+    } else if (_iType == IMU_TYPE_BMI270 || _iType == IMU_TYPE_BMI160) {
+        // The frames are parsed in place in the read buffer; the sensortime
+        // of the newest frame is available from getFIFOInfo() afterwards
+        uint8_t ucFIFO[IMU_MAX_I2C_READ];
+        uint8_t ucReg = (_iType == IMU_TYPE_BMI270) ? 0x24 : 0x22; // FIFO_LENGTH_0
+        int iLen, iChunk, iFrameLen, iTotal, iUsed, iLost, iRoom;
+
+        iCount = 0;
+        if (_iMode & MODE_ACCEL) iCount += 3;
+        if (_iMode & MODE_GYRO) iCount += 3;
+        *iNumSamples = 0;
+        if (iCount == 0) return IMU_SUCCESS;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, ucReg, ucTemp, 2)) { // FIFO_LENGTH_0/1
+            return IMU_ERROR;
+        }
+        iLen = ucTemp[0] | ((ucTemp[1] & ((_iType == IMU_TYPE_BMI270) ? 0x3f : 0x07)) << 8); // fill level in bytes
+        if (iLen == 0) return IMU_SUCCESS;
+        iLen += 4; // read past the end to collect the sensortime frame
+        iFrameLen = 1 + (iCount * 2); // header + data
+        // keep the reads aligned on frame boundaries when the transport limits the size
+        iChunk = (IMU_MAX_I2C_READ / iFrameLen) * iFrameLen;
+        if (iChunk == 0) iChunk = IMU_MAX_I2C_READ;
+        iTotal = 0;
+        iLost = _fifoInfo.iLost;
+        while (iLen > 0) {
+            // Frames which are read can't be put back, so never read more
+            // sample frames than there is room for: each one is at least
+            // iFrameLen bytes, so a read of iRoom bytes can't complete
+            // another one (a frame cut off at the end is repeated)
+            iRoom = (iMaxSamples - iTotal) * iFrameLen;
+            if (iRoom == 0 && iLen <= 4) iRoom = iLen; // only the sensortime frame is left
+            iNum = (iLen > iChunk) ? iChunk : iLen;
+            if (iNum > iRoom) iNum = iRoom;
+            if (iNum == 0) break; // no room for more samples
+            if (!I2CReadRegister(&_bbi2c, _iAddr, ucReg + 2, ucFIFO, iNum)) { // FIFO_DATA
+                return IMU_ERROR;
+            }
+            iTotal += parseBMIFIFO(_iType, _iMode, ucFIFO, iNum, &pSamples[iTotal * iCount], iMaxSamples - iTotal, &_fifoInfo, &iUsed);
+            if (iUsed == 0) break; // FIFO is empty
+            iLen -= iUsed;
+        }
+        *iNumSamples = iTotal;
+        if (_fifoInfo.iLost != iLost) { // skip frames, frames without an enabled sensor, resyncs
+            IMU_STATS_ADD(u32Overflows, 1);
+            IMU_STATS_ADD(u32Dropped, _fifoInfo.iLost - iLost);
+        }
+    } else if (_iType == IMU_TYPE_MPU6050 || _iType == IMU_TYPE_MPU6500 || _iType == IMU_TYPE_MPU6886) {
+        uint8_t ucFIFO[(IMU_MAX_I2C_READ < 14) ? 14 : IMU_MAX_I2C_READ]; // at least one frame
+        const uint8_t *s;
+        int16_t *d = pSamples;
+        int iLen, iChunk;
+
+        *iNumSamples = 0;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x72, ucTemp, 2)) { // FIFO_COUNTH/L
+            return IMU_ERROR;
+        }
+        iLen = ((ucTemp[0] & 0x1f) << 8) | ucTemp[1]; // byte count
+        if (iLen >= ((_iType == IMU_TYPE_MPU6500) ? 512 : 1024)) {
+            // The FIFO overflowed and the oldest frame was partially overwritten,
+            // so the frames are no longer aligned. Throw it all away and start over
+            _fifoInfo.iLost += iLen / 14;
+            IMU_STATS_ADD(u32Overflows, 1);
+            IMU_STATS_ADD(u32Dropped, iLen / 14);
+            ucTemp[0] = 0x6a; // USER_CTRL
+            ucTemp[1] = 0x04; // FIFO_RESET (with FIFO_EN=0)
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[1] = 0x40; // FIFO_EN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+        iNum = iLen / 14; // each frame is accel(6) + temp(2) + gyro(6)
+        if (iNum > iMaxSamples) iNum = iMaxSamples;
+        iLen = iNum * 14;
+        iChunk = (IMU_MAX_I2C_READ / 14) * 14; // only read whole frames
+        if (iChunk == 0) iChunk = 14; // transport limit below one frame, read a frame at a time
+        while (iLen > 0) {
+            iCount = (iLen > iChunk) ? iChunk : iLen;
+            if (!I2CReadRegister(&_bbi2c, _iAddr, 0x74, ucFIFO, iCount)) { // FIFO_R_W
+                return IMU_ERROR;
+            }
+            for (s = ucFIFO; s < &ucFIFO[iCount]; s += 14) { // big-endian -> native
+                if (_iMode & MODE_GYRO) {
+                    d[0] = (int16_t)((s[8] << 8) | s[9]);
+                    d[1] = (int16_t)((s[10] << 8) | s[11]);
+                    d[2] = (int16_t)((s[12] << 8) | s[13]);
+                    d += 3;
+                }
+                if (_iMode & MODE_ACCEL) {
+                    d[0] = (int16_t)((s[0] << 8) | s[1]);
+                    d[1] = (int16_t)((s[2] << 8) | s[3]);
+                    d[2] = (int16_t)((s[4] << 8) | s[5]);
+                    d += 3;
+                }
+            }
+            iLen -= iCount;
+        }
+        *iNumSamples = iNum;
+    } else if (_iType == IMU_TYPE_QMI8658) {
+        int16_t iTemp;
+
+        *iNumSamples = 0;
+        iCount = 0;
+        if (_iMode & MODE_ACCEL) iCount += 3;
+        if (_iMode & MODE_GYRO) iCount += 3;
+        if (iCount == 0) return IMU_SUCCESS;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x15, ucTemp, 2)) { // FIFO_SMPL_CNT + FIFO_STATUS
+            return IMU_ERROR;
+        }
+        if (ucTemp[1] & 0x20) { // FIFO_OVFLOW
+            _fifoInfo.iLost++;
+            IMU_STATS_ADD(u32Overflows, 1);
+            IMU_STATS_ADD(u32Dropped, 1);
+        }
+        iNum = 2 * (ucTemp[0] | ((ucTemp[1] & 3) << 8)); // bytes in the FIFO
+        iNum /= (iCount * 2); // complete samples
+        if (iNum > iMaxSamples) iNum = iMaxSamples;
+        if (iNum == 0) return IMU_SUCCESS;
+        if (qmiCommand(0x05) != IMU_SUCCESS) { // CTRL_CMD_REQ_FIFO
+            return IMU_ERROR;
+        }
+        // samples are little-endian accel X/Y/Z then gyro X/Y/Z
+        if (readBurst(0x17, (uint8_t *)pSamples, iNum * iCount * 2, iCount * 2) != IMU_SUCCESS) { // FIFO_DATA
+            return IMU_ERROR;
+        }
+        ucTemp[0] = 0x14; // FIFO_CTRL
+        ucTemp[1] = _ucFIFOCtrl; // clear FIFO_RD_MODE to go back to collecting
+        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for (int i=0; i<iNum * iCount; i++) {
+            pSamples[i] = (int16_t)__builtin_bswap16((uint16_t)pSamples[i]);
+        }
+#endif
+        if (iCount == 6) { // swap to gyro first
+            for (int i=0; i<iNum * 6; i+=6) {
+                for (int j=0; j<3; j++) {
+                    iTemp = pSamples[i+j];
+                    pSamples[i+j] = pSamples[i+j+3];
+                    pSamples[i+j+3] = iTemp;
+                }
+            }
+        }
+        *iNumSamples = iNum;
+    } else if (_iType == IMU_TYPE_LIS3DH || _iType == IMU_TYPE_LIS3DSH) {
+        *iNumSamples = 0;
+        if (!(_iMode & MODE_ACCEL)) return IMU_SUCCESS;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x2f, ucTemp, 1)) { // FIFO_SRC(_REG)
+            return IMU_ERROR;
+        }
+        iNum = ucTemp[0] & 0x1f; // FSS = unread levels
+        if (ucTemp[0] & 0x40) { // OVRN - all 32 levels are full and at least 1 sample was lost
+            iNum = 32;
+            _fifoInfo.iLost++;
+            IMU_STATS_ADD(u32Overflows, 1);
+            IMU_STATS_ADD(u32Dropped, 1);
+        }
+        if (iNum > iMaxSamples) iNum = iMaxSamples;
+        if (iNum == 0) return IMU_SUCCESS;
+        // With the FIFO enabled, the auto-incremented address wraps from OUT_Z_H back
+        // to OUT_X_L, so all levels can be read in one burst. The LIS3DH auto-increments
+        // when the MSB of the sub-address is set, the LIS3DSH uses CTRL_REG6 ADD_INC
+        if (readBurst((_iType == IMU_TYPE_LIS3DH) ? 0xa8 : 0x28, (uint8_t *)pSamples, iNum * 6, 6) != IMU_SUCCESS) {
+            return IMU_ERROR;
+        }
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for (int i=0; i<iNum * 3; i++) {
+            pSamples[i] = (int16_t)__builtin_bswap16((uint16_t)pSamples[i]);
+        }
+#endif
+        *iNumSamples = iNum;
+    } else if (_iType == IMU_TYPE_ADXL345) {
+        *iNumSamples = 0;
+        if (!(_iMode & MODE_ACCEL)) return IMU_SUCCESS;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x39, ucTemp, 1)) { // FIFO_STATUS
+            return IMU_ERROR;
+        }
+        iNum = ucTemp[0] & 0x3f; // entries (0-32)
+        if (iNum > iMaxSamples) iNum = iMaxSamples;
+        // The FIFO only pops after DATAX0..DATAZ1 are read and the address
+        // doesn't wrap, so each entry needs its own 6-byte transaction
+        for (iCount = 0; iCount < iNum; iCount++) {
+            if (!I2CReadRegister(&_bbi2c, _iAddr, 0x32, (uint8_t *)&pSamples[iCount * 3], 6)) {
+                return IMU_ERROR;
+            }
+        }
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        for (int i=0; i<iNum * 3; i++) {
+            pSamples[i] = (int16_t)__builtin_bswap16((uint16_t)pSamples[i]);
+        }
+#endif
+        *iNumSamples = iNum;
+    }
+    IMU_STATS_ADD(u32Delivered, *iNumSamples);
+    return IMU_SUCCESS;
+} /* getQueuedSamples() */
+
+//
+// Configure the channels used for the FIFO and activate that mode
+// iWatermark is the FIFO threshold in samples (0 = chip default)
+//
+int BBIMU::configFIFO(int iWatermark)
+{
+    uint8_t ucEnable, ucTemp[8];
+    int iODR;
+
+        memset(&_fifoInfo, 0, sizeof(_fifoInfo));
+        _u32FIFOTime = 0;
+        _iWatermark = iWatermark; // before it's clamped to the chip limits
+        _bFIFO = (_iType != IMU_TYPE_LSM9DS1 && _iType != IMU_TYPE_BNO055 && (_u32Caps & IMU_CAP_FIFO));
+        if (_iType == IMU_TYPE_BMI270 || _iType == IMU_TYPE_BMI160) {
+            ucEnable = 0x10; // FIFO_CONFIG_1: header mode
+            iODR = 1; // frame length (header + data)
+            if (_iMode & MODE_ACCEL) {
+                ucEnable |= 0x40; // fifo_acc_en
+                iODR += 6;
+            }
+            if (_iMode & MODE_GYRO) {
+                ucEnable |= 0x80; // fifo_gyr_en
+                iODR += 6;
+            }
+            iODR *= iWatermark; // watermark is in bytes
+            if (_iType == IMU_TYPE_BMI270) {
+                if (iODR > 0x3fff) iODR = 0x3fff;
+                ucTemp[0] = 0x46; // FIFO_WTM_0
+                ucTemp[1] = (uint8_t)iODR;
+                ucTemp[2] = (uint8_t)(iODR >> 8);
+                ucTemp[3] = 0x02; // FIFO_CONFIG_0: fifo_time_en (sensortime frames)
+                if (_iFIFOMode == FIFO_MODE_FIFO) ucTemp[3] |= 1; // fifo_stop_on_full
+                ucTemp[4] = ucEnable; // FIFO_CONFIG_1
+                I2CWrite(&_bbi2c, _iAddr, ucTemp, 5);
+            } else { // BMI160 (always in stream mode)
+                iODR = (iODR + 3) >> 2; // watermark is in units of 4 bytes
+                if (iODR > 0xff) iODR = 0xff;
+                ucTemp[0] = 0x46; // FIFO_CONFIG_0
+                ucTemp[1] = (uint8_t)iODR;
+                ucTemp[2] = ucEnable | 0x02; // FIFO_CONFIG_1 + fifo_time_en (sensortime frames)
+                I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+            }
+            ucTemp[0] = 0x7e; // CMD
+            ucTemp[1] = 0xb0; // fifo_flush
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+        if (_iType == IMU_TYPE_QMI8658) {
+            ucEnable = 0xa4; // CTRL7 value with the sensors disabled
+            if (_iMode & MODE_GYRO) ucEnable |= 2;
+            if (_iMode & MODE_ACCEL) ucEnable |= 1;
+            // pick the smallest depth (16/32/64/128 samples) which holds
+            // twice the watermark (or 128 if there is no watermark)
+            iODR = 0;
+            while (iODR < 3 && (iWatermark == 0 || (16 << iODR) < iWatermark * 2)) {
+                iODR++;
+            }
+            if (iWatermark > 127) iWatermark = 127;
+            _ucFIFOCtrl = (iODR << 2) | ((_iFIFOMode == FIFO_MODE_FIFO) ? 1 : 2);
+            // The FIFO must be configured with the sensors disabled
+            ucTemp[0] = 8; // CTRL7
+            ucTemp[1] = 0xa4;
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x13; // FIFO_WTM_TH
+            ucTemp[1] = (uint8_t)iWatermark; // in samples
+            ucTemp[2] = _ucFIFOCtrl; // FIFO_CTRL: size + FIFO/stream mode
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+            qmiCommand(0x04); // CTRL_CMD_RST_FIFO
+            ucTemp[0] = 8; // CTRL7
+            ucTemp[1] = ucEnable;
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+        if (_iType == IMU_TYPE_LIS3DH || _iType == IMU_TYPE_LIS3DSH) {
+            // 32 level FIFO; the watermark is 0-31 samples
+            if (iWatermark > 31) iWatermark = 31;
+            ucTemp[0] = 0x2e; // FIFO_CTRL(_REG)
+            ucTemp[1] = 0; // bypass mode to reset the FIFO
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            if (_iType == IMU_TYPE_LIS3DH) {
+                ucTemp[0] = 0x24; // CTRL_REG5
+                ucTemp[1] = 0x40; // FIFO_EN
+                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+                ucTemp[0] = 0x2e; // FIFO_CTRL_REG
+                ucTemp[1] = ((_iFIFOMode == FIFO_MODE_FIFO) ? 0x40 : 0x80) | iWatermark;
+                if (_iFIFOMode == FIFO_MODE_TRIGGER) ucTemp[1] |= 0xc0; // stream-to-FIFO
+            } else { // LIS3DSH
+                ucTemp[0] = 0x25; // CTRL_REG6
+                ucTemp[1] = 0x40 | 0x10; // FIFO_EN + ADD_INC
+                if (iWatermark) ucTemp[1] |= 0x20; // WTM_EN
+                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+                ucTemp[0] = 0x2e; // FIFO_CTRL
+                ucTemp[1] = ((_iFIFOMode == FIFO_MODE_FIFO) ? 0x20 : 0x40) | iWatermark;
+                if (_iFIFOMode == FIFO_MODE_TRIGGER) ucTemp[1] |= 0x60; // stream-to-FIFO
+            }
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+        if (_iType == IMU_TYPE_ADXL345) {
+            if (iWatermark > 31) iWatermark = 31;
+            ucTemp[0] = 0x38; // FIFO_CTL
+            ucTemp[1] = 0; // bypass mode to reset the FIFO
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            if (_iFIFOMode == FIFO_MODE_FIFO) ucTemp[1] = 0x40;
+            else if (_iFIFOMode == FIFO_MODE_TRIGGER) ucTemp[1] = 0xc0; // trigger event on INT1
+            else ucTemp[1] = 0x80; // stream
+            ucTemp[1] |= iWatermark; // samples bits = watermark level
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+        if (_iType == IMU_TYPE_MPU6050 || _iType == IMU_TYPE_MPU6500 || _iType == IMU_TYPE_MPU6886) {
+            ucTemp[0] = 0x6a; // USER_CTRL
+            ucTemp[1] = 0x04; // disable and reset the FIFO
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            if (_iType == IMU_TYPE_MPU6886 && iWatermark > 0) {
+                iODR = iWatermark * 14; // watermark is in bytes
+                if (iODR > 1023) iODR = 1023;
+                ucTemp[0] = 0x60; // FIFO_WM_TH1/TH2
+                ucTemp[1] = (uint8_t)(iODR >> 8);
+                ucTemp[2] = (uint8_t)iODR;
+                I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+            }
+            // Always queue complete accel+temp+gyro frames (14 bytes)
+            ucTemp[0] = 0x23; // FIFO_EN
+            ucTemp[1] = (_iType == IMU_TYPE_MPU6886) ? 0x18 : 0xf8;
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x6a; // USER_CTRL
+            ucTemp[1] = 0x40; // FIFO_EN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            return IMU_SUCCESS;
+        }
+
+        if (_iType == IMU_TYPE_LSM6DS3) {
+            // calculate the ODR (output data rate)
+            iODR = 0;
+            if (_iAccRate == 12) {
+                iODR = 1; // 12.5hz low power
+            } else if (_iAccRate == 26) {
+                iODR = 2; // 26hz
+            } else if (_iAccRate == 52) {
+                iODR = 3; // 52hz
+            } else if (_iAccRate == 104) {
+                iODR = 4; // 104hz
+            } else if (_iAccRate == 208) {
+                iODR = 5; // 208hz
+            } else if (_iAccRate == 416) {
+                iODR = 6; // 416hz
+            } else if (_iAccRate == 833) {
+                iODR = 7; // 833hz
+            } else if (_iAccRate == 1660) {
+                iODR = 8; // 1660hz
+            } else if (_iAccRate == 3330) {
+                iODR = 9; // 3330hz
+            } else if (_iAccRate == 6660) {
+                iODR = 10; // 6660hz
+            }
+            // set bypass mode first to reset the FIFO
+            ucTemp[0] = 0x0a; // FIFO_CTRL5
+            ucTemp[1] = 0; // bypass mode (FIFO_MODE [2:0] = 000)
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            // set the FIFO threshold value (in 16-bit words)
+            iWatermark *= (((_iMode & MODE_ACCEL) ? 3 : 0) + ((_iMode & MODE_GYRO) ? 3 : 0));
+            if (iWatermark == 0) iWatermark = 2048;
+            else if (iWatermark > 4095) iWatermark = 4095;
+            ucTemp[0] = 6; // FIFO_CTRL1 & FIFO_CTRL2
+            ucTemp[1] = (uint8_t)iWatermark; // low byte
+            ucTemp[2] = (uint8_t)(iWatermark >> 8); // high bits
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+
+            // Enable the accelerometer, gyro or both
+            ucEnable = 0;
+            if (_iMode & MODE_ACCEL) {
+                // enable only the requested channels
+//                ucTemp[0] = 0x18; // CTRL9_XL select channels for accelerometer
+//                ucTemp[1] = 0;
+//                if (u32Channels & IMU_CHANNEL_ACC_X) ucTemp[1] |= 8;
+//                if (u32Channels & IMU_CHANNEL_ACC_Y) ucTemp[1] |= 16;
+//                if (u32Channels & IMU_CHANNEL_ACC_Z) ucTemp[1] |= 32;
+//                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+                ucEnable |= 0x01; // enable accelerometer with no decimation
+            }
+            if (_iMode & MODE_GYRO) {
+                // enable only the requested channels
+//                ucTemp[0] = 0x19; // CTRL10_C select channels for gyroscope
+//                ucTemp[1] = 0;
+//                if (u32Channels & IMU_CHANNEL_GYR_X) ucTemp[1] |= 8;
+//                if (u32Channels & IMU_CHANNEL_GYR_Y) ucTemp[1] |= 16;
+//                if (u32Channels & IMU_CHANNEL_GYR_Z) ucTemp[1] |= 32;
+//                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+                ucEnable |= 0x8; // enable gyroscope with no decimation
+            }
+            ucTemp[0] = 0x8; // FIFO_CTRL3
+            ucTemp[1] = ucEnable; // enables acc, gyr or both
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            // turn on the FIFO
+            ucTemp[0] = 0x0a; // FIFO_CTRL5
+            ucTemp[1] = (iODR << 3); // FIFO mode enabled
+            ucTemp[1] |= 0x06; // continuous update - old data is tossed as new arrives
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    //        ucTemp[0] = 0x1a; // MASTR_CONFIG
+    //        ucTemp[1] = 0x00; // start?
+    //        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+        }
+        return IMU_SUCCESS;
+
+} /* configFIFO() */
+
+//
+// Set the behavior of the FIFO when it fills up
+// (FIFO_MODE_STREAM, FIFO_MODE_FIFO or FIFO_MODE_TRIGGER)
+// This takes effect on the next call to configFIFO()
+//
+void BBIMU::setFIFOMode(int iMode)
+{
+    _iFIFOMode = iMode;
+} /* setFIFOMode() */
+
+//
+// Send a CTRL9 command to the QMI8658 and wait for it to complete
+// (STATUSINT CmdDone bit), then acknowledge it
+//
+int BBIMU::qmiCommand(uint8_t ucCmd)
+{
+uint8_t ucTemp[2];
+int i;
+
+    ucTemp[0] = 0x0a; // CTRL9
+    ucTemp[1] = ucCmd;
+    I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    for (i=0; i<100; i++) { // each poll takes ~100us at 400khz
+        ucTemp[0] = 0;
+        I2CReadRegister(&_bbi2c, _iAddr, 0x2d, ucTemp, 1); // STATUSINT
+        if (ucTemp[0] & 0x80) break; // CmdDone
+    }
+    ucTemp[0] = 0x0a; // CTRL9
+    ucTemp[1] = 0x00; // CTRL_CMD_ACK
+    I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    return (i < 100) ? IMU_SUCCESS : IMU_ERROR;
+} /* qmiCommand() */
+
+//
+// Poll a register until (value & ucMask) == ucValue
+// or iTimeout milliseconds have passed
+//
+int BBIMU::waitReg(uint8_t ucReg, uint8_t ucMask, uint8_t ucValue, int iTimeout)
+{
+uint8_t uc;
+unsigned long ulStart = millis();
+
+    do {
+        uc = ~ucValue; // in case the read fails (e.g. NACK during a reset)
+        I2CReadRegister(&_bbi2c, _iAddr, ucReg, &uc, 1);
+        if ((uc & ucMask) == ucValue) {
+            return IMU_SUCCESS;
+        }
+    } while ((long)(millis() - ulStart) <= iTimeout);
+    return IMU_ERROR;
+} /* waitReg() */
+
+//
+// Load the BMI270 feature config in pieces the transport can carry
+// (INIT_ADDR selects the word offset of each piece), then wait for
+// INTERNAL_STATUS to report init_ok
+//
+int BBIMU::bmi270Upload(void)
+{
+uint8_t ucTemp[IMU_MAX_I2C_WRITE < 4 ? 4 : IMU_MAX_I2C_WRITE];
+int i, iLen, iChunk;
+
+    ucTemp[0] = 0x59; // INIT_CTRL
+    ucTemp[1] = 0; // prepare for the config load
+    I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    iLen = sizeof(bmi270_config_file) - 1; // the first byte is the INIT_DATA address
+    if ((int)sizeof(bmi270_config_file) <= IMU_MAX_I2C_WRITE) {
+        I2CWrite(&_bbi2c, _iAddr, (uint8_t *)bmi270_config_file, sizeof(bmi270_config_file));
+    } else {
+        iChunk = (IMU_MAX_I2C_WRITE - 1) & ~1; // must be whole 16-bit words
+        for (i=0; i<iLen; i+=iChunk) {
+            if (iChunk > iLen - i) iChunk = iLen - i;
+            ucTemp[0] = 0x5b; // INIT_ADDR_0/1
+            ucTemp[1] = (uint8_t)((i >> 1) & 0x0f);
+            ucTemp[2] = (uint8_t)(i >> 5);
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+            ucTemp[0] = 0x5e; // INIT_DATA
+            memcpy(&ucTemp[1], &bmi270_config_file[1 + i], iChunk);
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, iChunk + 1);
+        }
+    }
+    ucTemp[0] = 0x59; // INIT_CTRL
+    ucTemp[1] = 1; // start initialization
+    I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    return waitReg(0x21, 0x0f, 0x01, 50); // INTERNAL_STATUS = init_ok
+} /* bmi270Upload() */
+
+//
+// Switch the BNO055 operating mode and wait until SYS_STATUS shows
+// that the new mode is running (7ms from CONFIG, 19ms back to CONFIG)
+//
+int BBIMU::bnoMode(uint8_t ucMode)
+{
+uint8_t ucTemp[2], ucStatus;
+
+    ucTemp[0] = 0x3d; // OPR_MODE
+    ucTemp[1] = ucMode;
+    if (!I2CWrite(&_bbi2c, _iAddr, ucTemp, 2)) {
+        return IMU_ERROR;
+    }
+    _ucBNOMode = ucMode;
+    if (ucMode == BNO055_MODE_CONFIG) ucStatus = 0; // idle
+    else if (ucMode >= BNO055_MODE_IMU) ucStatus = 5; // sensor fusion running
+    else ucStatus = 6; // running without fusion
+    return waitReg(0x39, 0xff, ucStatus, 30); // SYS_STATUS
+} /* bnoMode() */
+
+//
+// Select a BNO055 operating mode (BNO055_MODE_xxx) after start()
+//
+int BBIMU::setBNOMode(int iOpMode)
+{
+    if (_iType != IMU_TYPE_BNO055 || iOpMode < BNO055_MODE_CONFIG || iOpMode > BNO055_MODE_NDOF) {
+        return IMU_ERROR;
+    }
+    if (_ucBNOMode != BNO055_MODE_CONFIG && iOpMode != BNO055_MODE_CONFIG) {
+        if (bnoMode(BNO055_MODE_CONFIG) != IMU_SUCCESS) { // modes only change from CONFIG
+            return IMU_ERROR;
+        }
+    }
+    return bnoMode((uint8_t)iOpMode);
+} /* setBNOMode() */
+
+//
+// Read the BNO055 fusion outputs (Euler angles, quaternion, linear
+// acceleration, gravity) and the calibration status in one burst
+//
+int BBIMU::getFusion(IMU_FUSION *pFusion)
+{
+uint8_t ucTemp[28];
+int i, iLen;
+
+    if (_iType != IMU_TYPE_BNO055) {
+        return IMU_ERROR;
+    }
+    // EUL_DATA (0x1a) through CALIB_STAT (0x35) are contiguous
+    for (i=0; i<(int)sizeof(ucTemp); i+=iLen) {
+        iLen = (int)sizeof(ucTemp) - i;
+        if (iLen > IMU_MAX_I2C_READ) iLen = IMU_MAX_I2C_READ;
+        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x1a + i, &ucTemp[i], iLen)) {
+            return IMU_ERROR;
+        }
+    }
+    for (i=0; i<3; i++) {
+        pFusion->euler[i] = get16Bits(&ucTemp[i*2]);
+        pFusion->linear[i] = get16Bits(&ucTemp[14 + i*2]);
+        pFusion->gravity[i] = get16Bits(&ucTemp[20 + i*2]);
+    }
+    for (i=0; i<4; i++) {
+        pFusion->quat[i] = get16Bits(&ucTemp[6 + i*2]);
+    }
+    pFusion->calib = ucTemp[27];
+    return IMU_SUCCESS;
+} /* getFusion() */
+
+//
+// Return the BNO055 calibration status (CALIB_STAT)
+// bits 7-6 = system, 5-4 = gyro, 3-2 = accel, 1-0 = mag (3 = calibrated)
+//
+int BBIMU::getCalibStatus(void)
+{
+uint8_t uc;
+
+    if (_iType != IMU_TYPE_BNO055 || !I2CReadRegister(&_bbi2c, _iAddr, 0x35, &uc, 1)) {
+        return IMU_ERROR;
+    }
+    return uc;
+} /* getCalibStatus() */
+
+//
+// Read (bSave = true) or write the BNO055 calibration profile
+// (accel, mag and gyro offsets + accel and mag radius, 0x55-0x6a)
+// pProfile holds IMU_BNO055_PROFILE_LEN bytes. The offset registers
+// are only accessible in CONFIG mode, so the operating mode is switched
+// there and back. Save a profile once getCalibStatus() reports a fully
+// calibrated system and restore it after power-up to skip calibration.
+//
+int BBIMU::bnoProfile(uint8_t *pProfile, bool bSave)
+{
+uint8_t ucTemp[IMU_BNO055_PROFILE_LEN + 1], ucMode;
+int i, iLen, rc = IMU_SUCCESS;
+
+    if (_iType != IMU_TYPE_BNO055) {
+        return IMU_ERROR;
+    }
+    ucMode = _ucBNOMode;
+    if (ucMode != BNO055_MODE_CONFIG && bnoMode(BNO055_MODE_CONFIG) != IMU_SUCCESS) {
+        return IMU_ERROR;
+    }
+    if (bSave) {
+        for (i=0; i<IMU_BNO055_PROFILE_LEN && rc == IMU_SUCCESS; i+=iLen) {
+            iLen = IMU_BNO055_PROFILE_LEN - i;
+            if (iLen > IMU_MAX_I2C_READ) iLen = IMU_MAX_I2C_READ;
+            if (!I2CReadRegister(&_bbi2c, _iAddr, 0x55 + i, &pProfile[i], iLen)) {
+                rc = IMU_ERROR;
+            }
+        }
+    } else {
+        for (i=0; i<IMU_BNO055_PROFILE_LEN && rc == IMU_SUCCESS; i+=iLen) {
+            iLen = IMU_BNO055_PROFILE_LEN - i;
+            if (iLen > IMU_MAX_I2C_WRITE - 1) iLen = IMU_MAX_I2C_WRITE - 1;
+            ucTemp[0] = 0x55 + i; // ACC_OFFSET_X_LSB + i
+            memcpy(&ucTemp[1], &pProfile[i], iLen);
+            if (!I2CWrite(&_bbi2c, _iAddr, ucTemp, iLen + 1)) {
+                rc = IMU_ERROR;
+            }
+        }
+    }
+    if (ucMode != BNO055_MODE_CONFIG && bnoMode(ucMode) != IMU_SUCCESS) {
+        rc = IMU_ERROR;
+    }
+    return rc;
+} /* bnoProfile() */
+
+int BBIMU::getCalibProfile(uint8_t *pProfile)
+{
+    return bnoProfile(pProfile, true);
+} /* getCalibProfile() */
+
+int BBIMU::setCalibProfile(const uint8_t *pProfile)
+{
+    return bnoProfile((uint8_t *)pProfile, false);
+} /* setCalibProfile() */
+
+//
+// Read (bSave = true) or write the chip's accel/gyro offset registers
+// Returns the number of bytes, or 0 if the chip has no offset registers
+//
+int BBIMU::offsetRegs(uint8_t *pData, bool bSave)
+{
+uint8_t ucTemp[8];
+const uint8_t *pRegs;
+int i, iLen;
+
+    switch (_iType) {
+        case IMU_TYPE_BNO055:
+            return (bnoProfile(pData, bSave) == IMU_SUCCESS) ? IMU_BNO055_PROFILE_LEN : 0;
+        case IMU_TYPE_MPU6050:
+            pRegs = mpu6050_offset_regs;
+            break;
+        case IMU_TYPE_MPU6500:
+        case IMU_TYPE_MPU6886:
+            pRegs = mpu6500_offset_regs;
+            break;
+        case IMU_TYPE_BMI160:
+        case IMU_TYPE_BMI270:
+            pRegs = bmi_offset_regs;
+            break;
+        case IMU_TYPE_LSM6DS3:
+            ucTemp[0] = 0;
+            I2CReadRegister(&_bbi2c, _iAddr, 0x0f, ucTemp, 1); // WHO_AM_I
+            if (ucTemp[0] != 0x6a) { // only the "C" variant has them
+                return 0;
+            }
+            pRegs = lsm6ds3_offset_regs;
+            break;
+        default:
+            return 0;
+    }
+    for (i=0; pRegs[0] != 0; pRegs += 2) {
+        iLen = pRegs[1];
+        if (bSave) {
+            if (!I2CReadRegister(&_bbi2c, _iAddr, pRegs[0], &pData[i], iLen)) {
+                return 0;
+            }
+        } else {
+            ucTemp[0] = pRegs[0];
+            memcpy(&ucTemp[1], &pData[i], iLen);
+            if (!I2CWrite(&_bbi2c, _iAddr, ucTemp, iLen + 1)) {
+                return 0;
+            }
+        }
+        i += iLen;
+    }
+    if (!bSave && _iType == IMU_TYPE_BMI270) { // accel offsets are enabled in NV_CONF
+        I2CReadRegister(&_bbi2c, _iAddr, 0x70, &ucTemp[1], 1);
+        ucTemp[0] = 0x70; // NV_CONF
+        ucTemp[1] |= 0x08; // acc_off_en
+        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    } else if (!bSave && _iType == IMU_TYPE_LSM6DS3) {
+        I2CReadRegister(&_bbi2c, _iAddr, 0x15, &ucTemp[1], 1);
+        ucTemp[0] = 0x15; // CTRL6_C
+        ucTemp[1] &= ~0x08; // USR_OFF_W = 2^-10 g/LSB
+        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+        I2CReadRegister(&_bbi2c, _iAddr, 0x16, &ucTemp[1], 1);
+        ucTemp[0] = 0x16; // CTRL7_G
+        ucTemp[1] |= 0x02; // USR_OFF_ON_OUT
+        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+    }
+    return i;
+} /* offsetRegs() */
+
+//
+// Unpack the accel and gyro offsets (in offset register units)
+// from the bytes read by offsetRegs()
+//
+void BBIMU::getOffsets(const uint8_t *pData, int *pAcc, int *pGyro)
+{
+int i, j;
+
+    for (i=0; i<3; i++) {
+        switch (_iType) {
+            case IMU_TYPE_MPU6050:
+            case IMU_TYPE_MPU6500:
+            case IMU_TYPE_MPU6886: // big-endian; accel bit 0 is reserved
+                pAcc[i] = (int16_t)((pData[i*2] << 8) | (pData[i*2+1] & 0xfe));
+                pGyro[i] = (int16_t)((pData[6+i*2] << 8) | pData[7+i*2]);
+                break;
+            case IMU_TYPE_BMI160:
+            case IMU_TYPE_BMI270: // 8-bit accel, 10-bit gyro (bits 9:8 in OFFSET_6)
+                pAcc[i] = (int8_t)pData[i];
+                j = pData[3+i] | (((pData[6] >> (i*2)) & 3) << 8);
+                pGyro[i] = (j & 0x200) ? j - 0x400 : j;
+                break;
+            default: // LSM6DS3 accel only
+                pAcc[i] = (int8_t)pData[i];
+                pGyro[i] = 0;
+                break;
+        }
+    }
+} /* getOffsets() */
+
+//
+// Pack the accel and gyro offsets into the offset register bytes
+// (values are clamped to the range of the registers)
+//
+void BBIMU::putOffsets(uint8_t *pData, const int *pAcc, const int *pGyro)
+{
+int i, iAcc, iGyro;
+
+    for (i=0; i<3; i++) {
+        iAcc = pAcc[i]; iGyro = pGyro[i];
+        switch (_iType) {
+            case IMU_TYPE_MPU6050:
+            case IMU_TYPE_MPU6500:
+            case IMU_TYPE_MPU6886:
+                if (iAcc < -32768) iAcc = -32768; else if (iAcc > 32767) iAcc = 32767;
+                if (iGyro < -32768) iGyro = -32768; else if (iGyro > 32767) iGyro = 32767;
+                pData[i*2] = (uint8_t)(iAcc >> 8);
+                pData[i*2+1] = (uint8_t)((iAcc & 0xfe) | (pData[i*2+1] & 1)); // keep the reserved bit
+                pData[6+i*2] = (uint8_t)(iGyro >> 8);
+                pData[7+i*2] = (uint8_t)iGyro;
+                break;
+            case IMU_TYPE_BMI160:
+            case IMU_TYPE_BMI270:
+                if (iAcc < -128) iAcc = -128; else if (iAcc > 127) iAcc = 127;
+                if (iGyro < -512) iGyro = -512; else if (iGyro > 511) iGyro = 511;
+                pData[i] = (uint8_t)iAcc;
+                pData[3+i] = (uint8_t)iGyro;
+                pData[6] = (pData[6] & ~(3 << (i*2))) | (((iGyro >> 8) & 3) << (i*2));
+                break;
+            default:
+                if (iAcc < -127) iAcc = -127; else if (iAcc > 127) iAcc = 127;
+                pData[i] = (uint8_t)iAcc;
+                break;
+        }
+    }
+    if (_iType == IMU_TYPE_BMI160) {
+        pData[6] |= 0xc0; // gyr_off_en, acc_off_en
+    } else if (_iType == IMU_TYPE_BMI270) {
+        pData[6] |= 0x40; // gyr_off_en
+    }
+} /* putOffsets() */
+
+//
+// Read the current contents of the offset registers so that they can be
+// stored and restored with setCalibration() on the next power-up
+// (the BNO055 calibration profile on that chip)
+//
+int BBIMU::getCalibration(IMU_CALIB *pCalib)
+{
+    memset(pCalib, 0, sizeof(IMU_CALIB));
+    pCalib->u8Type = (uint8_t)_iType;
+    pCalib->u8Len = (uint8_t)offsetRegs(pCalib->u8Data, true);
+    return (pCalib->u8Len != 0) ? IMU_SUCCESS : IMU_ERROR;
+} /* getCalibration() */
+
+//
+// Write saved offsets back to the chip
+// Call it after start(), since start() may reset the chip
+//
+int BBIMU::setCalibration(const IMU_CALIB *pCalib)
+{
+uint8_t ucData[IMU_CALIB_LEN];
+
+    if (pCalib->u8Type != _iType || pCalib->u8Len == 0 || pCalib->u8Len > IMU_CALIB_LEN) {
+        return IMU_ERROR;
+    }
+    memcpy(ucData, pCalib->u8Data, pCalib->u8Len);
+    return (offsetRegs(ucData, false) == pCalib->u8Len) ? IMU_SUCCESS : IMU_ERROR;
+} /* setCalibration() */
+
+//
+// Measure the accel and gyro offsets while the device is held still
+// in the orientation iFace and write the corrections into the chip's
+// own offset registers, so that the samples (and FIFO data) come out
+// corrected with no work on the host. pCalib receives the new register
+// contents to save. Calling it once for each of the 6 faces gives an
+// accel correction which doesn't depend on the device being level or on
+// the sensitivity error; the last of the 6 calls writes it.
+// The BNO055 calibrates itself; its current profile is returned.
+// The LSM6DS3 has no gyro offset registers, so only its accel is corrected.
+//
+int BBIMU::calibrate(IMU_CALIB *pCalib, int iFace, int iSamples)
+{
+IMU_SAMPLE sample;
+int32_t i32Acc[3], i32Gyro[3];
+int iAcc[3], iGyro[3], i, j, iSign, iRate, iTimeout;
+float fAccUnit, fGyroUnit, fRaw[3], f;
+uint8_t ucReady;
+
+    if (getCalibration(pCalib) != IMU_SUCCESS) {
+        return IMU_ERROR;
+    }
+    if (_iType == IMU_TYPE_BNO055) {
+        return IMU_SUCCESS;
+    }
+    if (iFace < IMU_FACE_XUP || iFace > IMU_FACE_ZDOWN || iSamples <= 0 || _iAccOff < 0 || _fAccScale == 0.0f) {
+        return IMU_ERROR;
+    }
+    // size of one offset register step and whether it's added to
+    // or subtracted from the output
+    iSign = 1;
+    switch (_iType) {
+        case IMU_TYPE_BMI160:
+        case IMU_TYPE_BMI270:
+            fAccUnit = 0.0039f;
+            fGyroUnit = 0.061f;
+            break;
+        case IMU_TYPE_LSM6DS3:
+            fAccUnit = 1.0f / 1024.0f;
+            fGyroUnit = 0.0f;
+            iSign = -1;
+            break;
+        default: // MPU family (+/-16g and +/-1000dps steps)
+            fAccUnit = 1.0f / 2048.0f;
+            fGyroUnit = 1.0f / 32.8f;
+            break;
+    }
+    if (_iGyroOff < 0 || _fGyroScale == 0.0f) {
+        fGyroUnit = 0.0f; // leave the gyro offsets alone
+    }
+    ucReady = _ucAccReady | ((_iGyroOff >= 0) ? _ucGyroReady : 0);
+    iRate = (_iAccRate > 0) ? _iAccRate : 100;
+    iTimeout = 2000 / iRate + 10;
+    for (i=0; i<3; i++) {
+        i32Acc[i] = i32Gyro[i] = 0;
+    }
+    for (j=0; j<iSamples; j++) { // average the still period
+        if (_iStatus != 0 && ucReady != 0) {
+            waitReg((uint8_t)_iStatus, ucReady, ucReady, iTimeout);
+        } else {
+            delay(1 + 1000 / iRate);
+        }
+        if (getSample(&sample) != IMU_SUCCESS) {
+            return IMU_ERROR;
+        }
+        for (i=0; i<3; i++) {
+            i32Acc[i] += sample.accel[i];
+            i32Gyro[i] += sample.gyro[i];
+        }
+    }
+    getOffsets(pCalib->u8Data, iAcc, iGyro);
+    for (i=0; i<3; i++) { // sensor output without the offsets already applied
+        fRaw[i] = (float)i32Acc[i] / iSamples - iSign * iAcc[i] * fAccUnit / _fAccScale;
+    }
+    _i32Face[iFace] = (int32_t)fRaw[iFace >> 1];
+    _ucFaces |= (1 << iFace);
+    for (i=0; i<3; i++) {
+        if (_ucFaces == 0x3f) { // midpoint between +1g and -1g
+            f = (float)(_i32Face[i*2] + _i32Face[i*2+1]) / 2.0f;
+        } else { // 1g on the axis facing up or down
+            f = fRaw[i];
+            if (i == (iFace >> 1)) f += ((iFace & 1) ? 1.0f : -1.0f) / _fAccScale;
+        }
+        f = -iSign * f * _fAccScale / fAccUnit;
+        iAcc[i] = (int)(f + ((f < 0.0f) ? -0.5f : 0.5f));
+        if (fGyroUnit != 0.0f) { // new = old - mean, in register steps
+            f = iGyro[i] - iSign * ((float)i32Gyro[i] / iSamples) * _fGyroScale / fGyroUnit;
+            iGyro[i] = (int)(f + ((f < 0.0f) ? -0.5f : 0.5f));
+        }
+    }
+    if (_ucFaces == 0x3f) _ucFaces = 0; // start a new set
+    putOffsets(pCalib->u8Data, iAcc, iGyro);
+    return setCalibration(pCalib);
+} /* calibrate() */
+
+//
+// Read the status register
+// This is usually needed to clear the last interrupt event
+//
+uint8_t BBIMU::getStatus(void)
+{
+    uint8_t uc;
+    I2CReadRegister(&_bbi2c, _iAddr, _iStatus, &uc, 1);
+    return uc;
+} /* getStatus() */
+
+//
+// Enable or disable interrupts on the INT1 or INT2 pin
+// iSources is a combination of IMU_IRQ_DATA_READY, IMU_IRQ_FIFO_WATERMARK
+// and IMU_IRQ_FIFO_FULL. Not every chip can route every source to both pins:
+// the MPU family has a single pin (and the MPU6050/6500 have no watermark,
+// so it is signaled as FIFO full), the LIS3DH/LIS3DSH FIFO events are INT1
+// only and the QMI8658 data-ready is INT2 only.
+//
+int BBIMU::configIRQ(bool bOn, int iSources, int iPin)
+{
+uint8_t ucTemp[4], ucBits;
+bool bDRDY, bWTM, bFull, bInt2;
+
+    bDRDY = bOn && (iSources & IMU_IRQ_DATA_READY);
+    bWTM = bOn && (iSources & IMU_IRQ_FIFO_WATERMARK);
+    bFull = bOn && (iSources & IMU_IRQ_FIFO_FULL);
+    bInt2 = (iPin == 2);
+    switch (_iType) {
+        case IMU_TYPE_BMI270:
+            ucBits = (bDRDY ? 0x04 : 0) | (bWTM ? 0x02 : 0) | (bFull ? 0x01 : 0);
+            ucTemp[0] = (bInt2) ? 0x54 : 0x53; // INT2_IO_CTRL / INT1_IO_CTRL
+            ucTemp[1] = 0x0a; // output enable, active high, push-pull
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x58; // INT_MAP_DATA
+            ucTemp[1] = (bInt2) ? (ucBits << 4) : ucBits; // drdy/fwm/ffull
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        case IMU_TYPE_LSM6DS3:
+        case IMU_TYPE_LSM9DS1: // same bit layout
+            ucTemp[0] = (_iType == IMU_TYPE_LSM6DS3) ? 0x0d : 0x0c; // INT1_CTRL
+            if (bInt2) ucTemp[0]++; // INT2_CTRL
+            ucTemp[1] = (bDRDY) ? 0x03 : 0x00; // INT_DRDY_G | INT_DRDY_XL; // data ready acc+gyr
+            if (bWTM) ucTemp[1] |= 0x08; // INT_FTH
+            if (bFull) ucTemp[1] |= 0x30; // INT_FULL_FLAG (FSS5) + INT_FIFO_OVR
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        case IMU_TYPE_MPU6050:
+        case IMU_TYPE_MPU6500:
+        case IMU_TYPE_MPU6886:
+            // The MPU6886 raises the watermark interrupt by itself
+            // once FIFO_WM_TH is set by configFIFO()
+            if (_iType != IMU_TYPE_MPU6886 && bWTM) bFull = true;
+            // only change the latch bits; BYPASS_EN must stay as it is for the aux bus
+            ucTemp[1] = 0;
+            I2CReadRegister(&_bbi2c, _iAddr, 0x37, &ucTemp[1], 1);
+            ucTemp[0] = 0x37; // INT_PIN_CFG
+            ucTemp[1] |= 0x30; // LATCH_INT_EN + INT_RD_CLEAR: latched until any register read
+            ucTemp[2] = (bDRDY) ? 0x01 : 0x00; // INT_ENABLE: DATA_RDY_EN
+            if (bFull) ucTemp[2] |= 0x10; // FIFO_OFLOW_EN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+            break;
+        case IMU_TYPE_ADXL345:
+            ucBits = (bDRDY ? 0x80 : 0) | (bWTM ? 0x02 : 0) | (bFull ? 0x01 : 0);
+            ucTemp[0] = 0x2f; // INT_MAP (map before enabling)
+            ucTemp[1] = (bInt2) ? ucBits : 0x00; // set bits go to INT2
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x2e; // INT_ENABLE
+            ucTemp[1] = ucBits; // DATA_READY/Watermark/Overrun
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        case IMU_TYPE_BMI160:
+            ucBits = (bDRDY ? 0x80 : 0) | (bWTM ? 0x40 : 0) | (bFull ? 0x20 : 0); // INT1 bits
+            ucTemp[0] = 0x51; // INT_EN_1
+            ucTemp[1] = (bDRDY ? 0x10 : 0) | (bFull ? 0x20 : 0) | (bWTM ? 0x40 : 0); // int_drdy_en/int_ffull_en/int_fwm_en
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x53; // INT_OUT_CTRL
+            ucTemp[1] = (bInt2) ? 0xa0 : 0x0a; // output enable, active high, push-pull
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 0x56; // INT_MAP_1
+            ucTemp[1] = (bInt2) ? (ucBits >> 4) : ucBits;
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        case IMU_TYPE_LIS3DH:
+            if (bInt2 && bOn) return IMU_ERROR; // INT2 has no data/FIFO events
+            ucTemp[0] = 0x22; // CTRL_REG3
+            ucTemp[1] = (bDRDY ? 0x10 : 0) | (bWTM ? 0x04 : 0) | (bFull ? 0x02 : 0); // I1_ZYXDA, I1_WTM, I1_OVERRUN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        case IMU_TYPE_LIS3DSH:
+            if (bInt2 && bOn) return IMU_ERROR; // FIFO events are INT1 only
+            ucTemp[0] = 0x23; // CTRL_REG3
+            ucTemp[1] = (bDRDY || bWTM || bFull) ? 0x48 : 0x00; // active high, INT1_EN
+            if (bDRDY) ucTemp[1] |= 0x80; // DR_EN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[1] = 0x10;
+            I2CReadRegister(&_bbi2c, _iAddr, 0x25, &ucTemp[1], 1);
+            ucTemp[0] = 0x25; // CTRL_REG6
+            ucTemp[1] &= 0x50; // keep FIFO_EN + ADD_INC
+            if (bWTM) ucTemp[1] |= (_bFIFO) ? 0x24 : 0x04; // WTM_EN + P1_WTM
+            if (bFull) ucTemp[1] |= 0x02; // P1_OVERRUN
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break; // LIS3DH / LIS3DSH
+        case IMU_TYPE_QMI8658:
+            if (bDRDY && !bInt2) return IMU_ERROR; // data-ready is only on INT2
+            ucTemp[0] = 2; // CTRL1
+            ucTemp[1] = 0x40; // address auto-increment
+            if (bDRDY) ucTemp[1] |= 0x10; // INT2 enable
+            if (bWTM || bFull) ucTemp[1] |= (bInt2) ? 0x10 : 0x0c; // INT2, or INT1 + FIFO_INT_SEL
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            ucTemp[0] = 8; // CTRL7
+            ucTemp[1] = (bDRDY) ? 0x84 : 0xa4; // DRDY_DIS (bit 5) routes data-ready to INT2 when clear
+            if (_iMode & MODE_GYRO) ucTemp[1] |= 2;
+            if (_iMode & MODE_ACCEL) ucTemp[1] |= 1;
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            break;
+        default:
+           return IMU_ERROR;
+    } // switch on type
+    return IMU_SUCCESS;
+} /* configIRQ() */
+
+//
+// Return the number of complete samples waiting in the FIFO
+// Use this after a watermark interrupt to size the drain
+//
+int BBIMU::getFIFOCount(void)
+{
+uint8_t ucTemp[2];
+int iCount = 0;
+
+    if (_iMode & MODE_ACCEL) iCount += 3;
+    if (_iMode & MODE_GYRO) iCount += 3;
+    if (iCount == 0) return 0;
+    ucTemp[0] = ucTemp[1] = 0;
+    switch (_iType) {
+        case IMU_TYPE_LSM6DS3:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x3a, ucTemp, 2); // FIFO_STATUS1/2
+            return (ucTemp[0] | ((ucTemp[1] & 0xf) << 8)) / iCount;
+        case IMU_TYPE_BMI270:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x24, ucTemp, 2); // FIFO_LENGTH_0/1
+            return (ucTemp[0] | ((ucTemp[1] & 0x3f) << 8)) / (1 + iCount * 2);
+        case IMU_TYPE_BMI160:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x22, ucTemp, 2); // FIFO_LENGTH_0/1
+            return (ucTemp[0] | ((ucTemp[1] & 0x07) << 8)) / (1 + iCount * 2);
+        case IMU_TYPE_MPU6050:
+        case IMU_TYPE_MPU6500:
+        case IMU_TYPE_MPU6886:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x72, ucTemp, 2); // FIFO_COUNTH/L
+            return (((ucTemp[0] & 0x1f) << 8) | ucTemp[1]) / 14;
+        case IMU_TYPE_QMI8658:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x15, ucTemp, 2); // FIFO_SMPL_CNT + FIFO_STATUS
+            return (ucTemp[0] | ((ucTemp[1] & 3) << 8)) / iCount;
+        case IMU_TYPE_LIS3DH:
+        case IMU_TYPE_LIS3DSH:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x2f, ucTemp, 1); // FIFO_SRC(_REG)
+            return (ucTemp[0] & 0x40) ? 32 : (ucTemp[0] & 0x1f);
+        case IMU_TYPE_ADXL345:
+            I2CReadRegister(&_bbi2c, _iAddr, 0x39, ucTemp, 1); // FIFO_STATUS
+            return ucTemp[0] & 0x3f;
+        default:
+            return IMU_ERROR;
+    }
+} /* getFIFOCount() */
+
+
+//
+// Convert one FIFO entry from getQueuedSamples() (gyro X/Y/Z then
+// accel X/Y/Z of the enabled sensors) into a sample
+// Returns the number of values used
+//
+int BBIMU::unpackFIFO(IMU_SAMPLE *pSample, const int16_t *pData)
+{
+int i, j = 0;
+
+    memset(pSample, 0, sizeof(IMU_SAMPLE));
+    if (_iMode & MODE_GYRO && _u32Caps & IMU_CAP_GYROSCOPE) {
+        for (i=0; i<3; i++) pSample->gyro[i] = pData[j++];
+    }
+    if (_iMode & MODE_ACCEL) {
+        for (i=0; i<3; i++) pSample->accel[i] = pData[j++];
+    }
+    return j;
+} /* unpackFIFO() */
+
+//
+// Measure the chip's clock against micros(). u32Units counts either
+// sensortime ticks (39.0625us) or samples (one nominal sample period each).
+// The error is measured over a window of IMU_CLOCK_WINDOW; after the first
+// window, each new window is blended in as it grows so that the estimate
+// doesn't jump when the window is restarted.
+//
+void BBIMU::trackClock(uint32_t u32Units, uint32_t u32Host, bool bTicks)
+{
+uint32_t u32Elapsed;
+int64_t i64Chip;
+int iRate, iPPM;
+
+    if (!_bClockRef) { // open a new window
+        _bClockRef = true;
+        _u32HostRef = u32Host;
+        _u32ChipRef = u32Units;
+        _iPrevPPM = _iClockPPM;
+        return;
+    }
+    u32Elapsed = u32Host - _u32HostRef;
+    if (u32Elapsed < 1000000) { // too short to be meaningful
+        return;
+    }
+    if (bTicks) {
+        i64Chip = ((int64_t)(u32Units - _u32ChipRef) * 625) / 16;
+    } else {
+        iRate = (_iMode & MODE_ACCEL) ? _iAccRate : _iGyroRate;
+        if (iRate <= 0) return;
+        i64Chip = ((int64_t)(u32Units - _u32ChipRef) * 1000000) / iRate;
+    }
+    iPPM = (int)(((i64Chip - (int64_t)u32Elapsed) * 1000000) / (int64_t)u32Elapsed);
+    if (_bClockValid && u32Elapsed < IMU_CLOCK_WINDOW * 1000) {
+        iPPM = _iPrevPPM + (int)(((int64_t)(iPPM - _iPrevPPM) * u32Elapsed) / (int64_t)(IMU_CLOCK_WINDOW * 1000));
+    }
+    _iClockPPM = iPPM;
+    if (u32Elapsed >= IMU_CLOCK_WINDOW * 1000) { // restart the window from here
+        _bClockValid = true;
+        _u32HostRef = u32Host;
+        _u32ChipRef = u32Units;
+        _iPrevPPM = iPPM;
+    }
+} /* trackClock() */
+
+//
+// Convert a BMI160/BMI270 sensortime reading taken at micros() time u32Now
+// into the micros() time of the newest sample. The output data rates are
+// derived from the sensortime counter, so samples are produced when the
+// low bits (25600/ODR ticks) roll over.
+//
+uint32_t BBIMU::sensorTime(uint32_t u32Sensor, uint32_t u32Now)
+{
+uint32_t u32Ticks, u32Phase;
+int iRate;
+
+    u32Ticks = (u32Sensor - _u32SensorTime) & 0xffffff; // unwrap the 24-bit counter
+    _u32SensorTime = u32Sensor;
+    if (u32Ticks & 0x800000) { // stale value or read too far apart to unwrap
+        _bClockRef = false;
+    } else {
+        _u32ChipUnits += u32Ticks;
+        trackClock(_u32ChipUnits, u32Now, true);
+    }
+    iRate = (_iMode & MODE_ACCEL) ? _iAccRate : _iGyroRate;
+    if (iRate <= 0) return u32Now;
+    for (u32Ticks = 1; u32Ticks * 2 <= (uint32_t)(25600 / iRate); u32Ticks *= 2) {};
+    u32Phase = u32Sensor & (u32Ticks - 1); // ticks since the newest sample
+    return u32Now - ((u32Phase * 625) / 16);
+} /* sensorTime() */
+
+//
+// Describe the 16-bit sample frames for decodeFrames()/convertFrames()
+// bQueued = true for the output of getQueuedSamples() (native byte order,
+// gyro before accel), false for the bytes as they come out of the FIFO
+// data register. The BMI160/BMI270 FIFOs use headered frames which have
+// to go through parseBMIFIFO() (getQueuedSamples()) first.
+// The scale factors match the ranges set by the last start().
+//
+int BBIMU::getFrameFormat(IMU_FRAME_FORMAT *pFmt, bool bQueued)
+{
+bool bAcc, bGyro;
+
+    bAcc = (_iMode & MODE_ACCEL && _u32Caps & IMU_CAP_ACCELEROMETER);
+    bGyro = (_iMode & MODE_GYRO && _u32Caps & IMU_CAP_GYROSCOPE);
+    pFmt->fAccScale = _fAccScale;
+    pFmt->fGyroScale = _fGyroScale;
+    if (bQueued) {
+        pFmt->u8Gyro = (bGyro) ? 0 : 0xff;
+        pFmt->u8Acc = (bAcc) ? ((bGyro) ? 6 : 0) : 0xff;
+        pFmt->u8FrameLen = (bAcc ? 6 : 0) + (bGyro ? 6 : 0);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+        pFmt->bBigEndian = 1;
+#else
+        pFmt->bBigEndian = 0;
+#endif
+        return IMU_SUCCESS;
+    }
+    pFmt->bBigEndian = 0;
+    switch (_iType) {
+        case IMU_TYPE_LSM6DS3: // gyro X/Y/Z then accel X/Y/Z
+            pFmt->u8Gyro = (bGyro) ? 0 : 0xff;
+            pFmt->u8Acc = (bAcc) ? ((bGyro) ? 6 : 0) : 0xff;
+            pFmt->u8FrameLen = (bAcc ? 6 : 0) + (bGyro ? 6 : 0);
+            break;
+        case IMU_TYPE_QMI8658: // accel X/Y/Z then gyro X/Y/Z
+            pFmt->u8Acc = (bAcc) ? 0 : 0xff;
+            pFmt->u8Gyro = (bGyro) ? ((bAcc) ? 6 : 0) : 0xff;
+            pFmt->u8FrameLen = (bAcc ? 6 : 0) + (bGyro ? 6 : 0);
+            break;
+        case IMU_TYPE_MPU6050:
+        case IMU_TYPE_MPU6500:
+        case IMU_TYPE_MPU6886: // accel(6) + temp(2) + gyro(6), big-endian
+            pFmt->bBigEndian = 1;
+            pFmt->u8Acc = (bAcc) ? 0 : 0xff;
+            pFmt->u8Gyro = (bGyro) ? 8 : 0xff;
+            pFmt->u8FrameLen = 14;
+            break;
+        case IMU_TYPE_LIS3DH:
+        case IMU_TYPE_LIS3DSH:
+        case IMU_TYPE_ADXL345:
+            pFmt->u8Acc = (bAcc) ? 0 : 0xff;
+            pFmt->u8Gyro = 0xff;
+            pFmt->u8FrameLen = 6;
+            break;
+        default:
+            return IMU_ERROR;
+    }
+    return IMU_SUCCESS;
+} /* getFrameFormat() */
+
+#ifdef IMU_SSE2
+//
+// Load the X/Y/Z values of 8 frames and transpose them into 8 X, 8 Y
+// and 8 Z values. Each frame is read as 8 bytes, so the 2 bytes past the
+// Z value of the last frame must belong to the buffer (a following frame).
+//
+static void imuLoad8(const uint8_t *s, int iStride, bool bBigEndian, __m128i *pX, __m128i *pY, __m128i *pZ)
+{
+__m128i a0, a1, a2, a3, b0, b1, b2, b3;
+
+    a0 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)s), _mm_loadl_epi64((const __m128i *)&s[iStride])); // x0 x1 y0 y1 z0 z1 -- --
+    a1 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)&s[iStride*2]), _mm_loadl_epi64((const __m128i *)&s[iStride*3]));
+    a2 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)&s[iStride*4]), _mm_loadl_epi64((const __m128i *)&s[iStride*5]));
+    a3 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)&s[iStride*6]), _mm_loadl_epi64((const __m128i *)&s[iStride*7]));
+    b0 = _mm_unpacklo_epi32(a0, a1); // x0 x1 x2 x3 y0 y1 y2 y3
+    b1 = _mm_unpackhi_epi32(a0, a1); // z0 z1 z2 z3 -- -- -- --
+    b2 = _mm_unpacklo_epi32(a2, a3);
+    b3 = _mm_unpackhi_epi32(a2, a3);
+    *pX = _mm_unpacklo_epi64(b0, b2);
+    *pY = _mm_unpackhi_epi64(b0, b2);
+    *pZ = _mm_unpacklo_epi64(b1, b3);
+    if (bBigEndian) { // swap the bytes of each value
+        *pX = _mm_or_si128(_mm_slli_epi16(*pX, 8), _mm_srli_epi16(*pX, 8));
+        *pY = _mm_or_si128(_mm_slli_epi16(*pY, 8), _mm_srli_epi16(*pY, 8));
+        *pZ = _mm_or_si128(_mm_slli_epi16(*pZ, 8), _mm_srli_epi16(*pZ, 8));
+    }
+} /* imuLoad8() */
+
+//
+// Scale 8 values to float and store them
+//
+static void imuStore8(__m128i v, __m128 vScale, float *pDest)
+{
+    // sign extend to 32 bits by moving each value into the upper half
+    _mm_storeu_ps(pDest, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)), vScale));
+    _mm_storeu_ps(&pDest[4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)), vScale));
+} /* imuStore8() */
+#endif // IMU_SSE2
+
+#ifdef IMU_NEON
+//
+// Load the X/Y/Z values of 4 frames and transpose them into 4 X, 4 Y
+// and 4 Z values. Each frame is read as 8 bytes, so the 2 bytes past the
+// Z value of the last frame must belong to the buffer (a following frame).
+//
+static void imuLoad4(const uint8_t *s, int iStride, bool bBigEndian, int16x4_t *pX, int16x4_t *pY, int16x4_t *pZ)
+{
+uint8x8_t f0, f1, f2, f3;
+int16x4x2_t t01, t23;
+int32x2x2_t xz, y;
+
+    f0 = vld1_u8(s); f1 = vld1_u8(&s[iStride]);
+    f2 = vld1_u8(&s[iStride*2]); f3 = vld1_u8(&s[iStride*3]);
+    if (bBigEndian) { // swap the bytes of each value
+        f0 = vrev16_u8(f0); f1 = vrev16_u8(f1);
+        f2 = vrev16_u8(f2); f3 = vrev16_u8(f3);
+    }
+    t01 = vtrn_s16(vreinterpret_s16_u8(f0), vreinterpret_s16_u8(f1)); // x0 x1 z0 z1, y0 y1 -- --
+    t23 = vtrn_s16(vreinterpret_s16_u8(f2), vreinterpret_s16_u8(f3));
+    xz = vtrn_s32(vreinterpret_s32_s16(t01.val[0]), vreinterpret_s32_s16(t23.val[0])); // x0 x1 x2 x3, z0 z1 z2 z3
+    y = vtrn_s32(vreinterpret_s32_s16(t01.val[1]), vreinterpret_s32_s16(t23.val[1]));
+    *pX = vreinterpret_s16_s32(xz.val[0]);
+    *pY = vreinterpret_s16_s32(y.val[0]);
+    *pZ = vreinterpret_s16_s32(xz.val[1]);
+} /* imuLoad4() */
+#endif // IMU_NEON
+
+//
+// Copy the X/Y/Z values of iCount frames into 3 planes (X[0..iCount-1],
+// then Y, then Z). With SSE2/NEON, groups of 8/4 frames are transposed
+// in registers; the plain C loop does the rest (or everything). The
+// frame before the last one is the last one done with SIMD, so the
+// 8-byte frame loads never read past the end of the data.
+//
+static void imuDecode3(const uint8_t * __restrict s, int iStride, int iCount, bool bBigEndian, int16_t * __restrict pX)
+{
+int i = 0;
+int16_t *pY = &pX[iCount], *pZ = &pX[iCount * 2];
+#ifdef IMU_SSE2
+__m128i x, y, z;
+
+    for (; i + 8 < iCount; i += 8) {
+        imuLoad8(s, iStride, bBigEndian, &x, &y, &z);
+        _mm_storeu_si128((__m128i *)&pX[i], x);
+        _mm_storeu_si128((__m128i *)&pY[i], y);
+        _mm_storeu_si128((__m128i *)&pZ[i], z);
+        s += iStride * 8;
+    }
+#endif
+#ifdef IMU_NEON
+int16x4_t x, y, z;
+
+    for (; i + 4 < iCount; i += 4) {
+        imuLoad4(s, iStride, bBigEndian, &x, &y, &z);
+        vst1_s16(&pX[i], x);
+        vst1_s16(&pY[i], y);
+        vst1_s16(&pZ[i], z);
+        s += iStride * 4;
+    }
+#endif
+    if (bBigEndian) {
+        for (; i<iCount; i++) {
+            pX[i] = (int16_t)((s[0] << 8) | s[1]);
+            pY[i] = (int16_t)((s[2] << 8) | s[3]);
+            pZ[i] = (int16_t)((s[4] << 8) | s[5]);
+            s += iStride;
+        }
+    } else {
+        for (; i<iCount; i++) {
+            pX[i] = (int16_t)(s[0] | (s[1] << 8));
+            pY[i] = (int16_t)(s[2] | (s[3] << 8));
+            pZ[i] = (int16_t)(s[4] | (s[5] << 8));
+            s += iStride;
+        }
+    }
+} /* imuDecode3() */
+
+//
+// Same as imuDecode3(), but scaled to physical units
+//
+static void imuConvert3(const uint8_t * __restrict s, int iStride, int iCount, bool bBigEndian, float fScale, float * __restrict pX)
+{
+int i = 0;
+float *pY = &pX[iCount], *pZ = &pX[iCount * 2];
+#ifdef IMU_SSE2
+__m128i x, y, z;
+__m128 vScale = _mm_set1_ps(fScale);
+
+    for (; i + 8 < iCount; i += 8) {
+        imuLoad8(s, iStride, bBigEndian, &x, &y, &z);
+        imuStore8(x, vScale, &pX[i]);
+        imuStore8(y, vScale, &pY[i]);
+        imuStore8(z, vScale, &pZ[i]);
+        s += iStride * 8;
+    }
+#endif
+#ifdef IMU_NEON
+int16x4_t x, y, z;
+
+    for (; i + 4 < iCount; i += 4) {
+        imuLoad4(s, iStride, bBigEndian, &x, &y, &z);
+        vst1q_f32(&pX[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(x)), fScale));
+        vst1q_f32(&pY[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(y)), fScale));
+        vst1q_f32(&pZ[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(z)), fScale));
+        s += iStride * 4;
+    }
+#endif
+    if (bBigEndian) {
+        for (; i<iCount; i++) {
+            pX[i] = (float)(int16_t)((s[0] << 8) | s[1]) * fScale;
+            pY[i] = (float)(int16_t)((s[2] << 8) | s[3]) * fScale;
+            pZ[i] = (float)(int16_t)((s[4] << 8) | s[5]) * fScale;
+            s += iStride;
+        }
+    } else {
+        for (; i<iCount; i++) {
+            pX[i] = (float)(int16_t)(s[0] | (s[1] << 8)) * fScale;
+            pY[i] = (float)(int16_t)(s[2] | (s[3] << 8)) * fScale;
+            pZ[i] = (float)(int16_t)(s[4] | (s[5] << 8)) * fScale;
+            s += iStride;
+        }
+    }
+} /* imuConvert3() */
+
+//
+// Split iFrames frames described by pFmt into planar accel and gyro
+// arrays of 3 * iFrames raw values each (either can be NULL)
+// No bus access happens here, so it can be used on captured data.
+//
+void BBIMU::decodeFrames(const IMU_FRAME_FORMAT *pFmt, const uint8_t *pData, int iFrames, int16_t *pAcc, int16_t *pGyro)
+{
+    if (pAcc != NULL && pFmt->u8Acc != 0xff) {
+        imuDecode3(&pData[pFmt->u8Acc], pFmt->u8FrameLen, iFrames, pFmt->bBigEndian, pAcc);
+    }
+    if (pGyro != NULL && pFmt->u8Gyro != 0xff) {
+        imuDecode3(&pData[pFmt->u8Gyro], pFmt->u8FrameLen, iFrames, pFmt->bBigEndian, pGyro);
+    }
+} /* decodeFrames() */
+
+//
+// Same as decodeFrames(), but in g and degrees per second
+//
+void BBIMU::convertFrames(const IMU_FRAME_FORMAT *pFmt, const uint8_t *pData, int iFrames, float *pAcc, float *pGyro)
+{
+    if (pAcc != NULL && pFmt->u8Acc != 0xff) {
+        imuConvert3(&pData[pFmt->u8Acc], pFmt->u8FrameLen, iFrames, pFmt->bBigEndian, pFmt->fAccScale, pAcc);
+    }
+    if (pGyro != NULL && pFmt->u8Gyro != 0xff) {
+        imuConvert3(&pData[pFmt->u8Gyro], pFmt->u8FrameLen, iFrames, pFmt->bBigEndian, pFmt->fGyroScale, pGyro);
+    }
+} /* convertFrames() */
+
+//
+// Work out the accelerometer sensitivity (g per LSB) for the range
+// that start() selected; the gyro sensitivity comes from the device table
+//
+void BBIMU::setAccSensitivity(void)
+{
+    switch (_iType) {
+        case IMU_TYPE_ADXL345: // full resolution mode, right justified
+            _fAccScale = 0.0039f;
+            break;
+        case IMU_TYPE_BNO055: // 1 m/s^2 = 100 LSB
+            _fAccScale = 1.0f / (100.0f * 9.80665f);
+            break;
+        case IMU_TYPE_LIS3DH: // 12mg/digit (12-bit) at 16g instead of 8
+        case IMU_TYPE_LIS3DSH:
+            if (_iAccScale == ACCEL_SCALE_16G) {
+                _fAccScale = (_iType == IMU_TYPE_LIS3DH) ? 0.00075f : 0.00073f;
+                break;
+            }
+            // fall through
+        default: // +/-2/4/8/16g over the full 16-bit range
+            _fAccScale = (float)(2 << _iAccScale) / 32768.0f;
+            break;
+    }
+} /* setAccSensitivity() */
+
+//
+// Reconstruct the timestamps of iCount samples just read from the FIFO
+// spaced by the measured sample period. On the BMI160/BMI270 the
+// sensortime frame at the end of the FIFO gives the time of the newest
+// sample. Otherwise the newest one was captured within the last sample
+// period (iPending periods earlier when samples were left in the FIFO),
+// so the batch is placed to end then; when the previous batch
+// predicts an end time which is still in that window, it is used instead
+// to keep the timestamps free of bus and scheduling jitter.
+// The FIFO fill rate also feeds the clock estimate on the other chips.
+// Returns the timestamp of the first (oldest) sample
+//
+uint32_t BBIMU::fifoTime(int iCount, int iPending, uint32_t *pu32Period)
+{
+uint32_t u32Now, u32End, u32Period;
+int iRate;
+
+    iRate = (_iMode & MODE_ACCEL) ? _iAccRate : _iGyroRate;
+    u32Period = (iRate > 0) ? (uint32_t)(1000000000000LL / ((int64_t)iRate * (1000000 + _iClockPPM))) : 0;
+    u32Now = micros();
+    if (_iTimeStart != 0 && _fifoInfo.u32SensorTime != _u32FIFOTime) { // new sensortime frame
+        _u32FIFOTime = _fifoInfo.u32SensorTime;
+        u32End = sensorTime(_u32FIFOTime, u32Now);
+    } else {
+        u32Now -= iPending * u32Period; // when the newest sample read was captured
+        if (_iTimeStart == 0) { // count samples against the host clock
+            if (_fifoInfo.iLost != _iLostRef) { // samples went missing, restart the window
+                _iLostRef = _fifoInfo.iLost;
+                _bClockRef = false;
+            }
+            _u32ChipUnits += iCount;
+            trackClock(_u32ChipUnits, u32Now, false);
+        }
+        u32End = _u32LastStamp + (iCount * u32Period);
+        if (_u32LastStamp == 0 || (int32_t)(u32Now - u32End) < 0 || (u32Now - u32End) >= u32Period) {
+            u32End = u32Now; // resynchronize
+            if (_u32LastStamp != 0 && iCount > 0 && (int32_t)(u32End - ((iCount - 1) * u32Period) - _u32LastStamp) <= 0) {
+                u32End = _u32LastStamp + (iCount * u32Period); // but keep the timestamps in order
+            }
+        }
+    }
+    if (iCount > 0) _u32LastStamp = u32End;
+    *pu32Period = u32Period;
+    return u32End - ((iCount - 1) * u32Period);
+} /* fifoTime() */
+
+//
+// Chip clock error relative to micros() in parts per million
+// (positive = the chip runs fast)
+//
+int BBIMU::getClockPPM(void)
+{
+    return _iClockPPM;
+} /* getClockPPM() */
+
 //
-// Initialize the I2C interface and detect the chip type
+// Output data rate measured against micros() in millihertz
 //
-int BBIMU::init(int iSDA, int iSCL, bool bBitBang, uint32_t u32Speed)
+int BBIMU::getMeasuredRate(void)
 {
-uint8_t ucTemp[4];
-int iOffset;
+int iRate;
 
-    _bbi2c.iSDA = iSDA;
-    _bbi2c.iSCL = iSCL;
-    _bbi2c.bWire = !bBitBang;
-    I2CInit(&_bbi2c, u32Speed);
+    iRate = (_iMode & MODE_ACCEL) ? _iAccRate : _iGyroRate;
+    return (int)(((int64_t)iRate * (1000000 + _iClockPPM)) / 1000);
+} /* getMeasuredRate() */
 
-    for (iOffset = 0; iOffset<2; iOffset++) { // try both addresses of each device
-    // probe the I2C bus for devices
-    if (I2CTest(&_bbi2c, IMU_QMI8658_ADDR+iOffset)) {
-       // try to read the "WHOAMI" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_QMI8658_ADDR+iOffset, 0, ucTemp, 1);
-       if (ucTemp[0] == 0x05) {
-          _iType = IMU_TYPE_QMI8658;
-          _iAddr = IMU_QMI8658_ADDR + iOffset;
-          _bBigEndian = false;
-          _iAccStart = 0x35;
-          _iGyroStart = 0x3b;
-          _iStatus = 0x2e; // status register
-          _iTempStart = 0x33;
-          _iTempLen = 2;
-          _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_3DPOS;
-          ucTemp[0] = 2; // CTRL1
-          ucTemp[1] = 0x40; // enable auto-increment of addresses
-          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_BNO055_ADDR+iOffset)) {
-       // try to read the "CHIP_ID" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_BNO055_ADDR + iOffset, 0x0, ucTemp, 1);
-       if (ucTemp[0] == 0xa0) {
-           _iType = IMU_TYPE_BNO055;
-           _iAddr = IMU_BNO055_ADDR + iOffset;
-           _bBigEndian = false;
-           _iMagStart = 0xe;
-           _iAccStart = 0x8;
-           _iGyroStart = 0x14;
-           _iTempStart = 0x34;
-           _iTempLen = 1;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_MAGNETOMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_3DPOS;
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_BMI270_ADDR+iOffset)) {
-       // try to read the CHIP_ID register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_BMI270_ADDR+iOffset, 0x0, ucTemp, 1);
-       if (ucTemp[0] == 0x24) {
-           _iType = IMU_TYPE_BMI270;
-           _iAddr = IMU_BMI270_ADDR + iOffset;
-           _bBigEndian = false;
-           _iAccStart = 0xc;
-           _iGyroStart = 0x12;
-           _iTempStart = 0x22;
-           _iTempLen = 2;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-           return IMU_SUCCESS;
-       } 
-    }
-    if (I2CTest(&_bbi2c, IMU_LSM9DS1_ADDR+iOffset)) {
-       // try to read the "WHO_AM_I" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_LSM9DS1_ADDR + iOffset, 0x0f, ucTemp, 1);
-       if (ucTemp[0] == 0x68) {
-           _iType = IMU_TYPE_LSM9DS1;
-           _iAddr = IMU_LSM9DS1_ADDR + iOffset;
-           _bBigEndian = false;
-           _iAccStart = 0x28;
-           _iGyroStart = 0x18;
-           _iTempStart = 0x15;
-           _iTempLen = 2;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_MAGNETOMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_LSM6DS3_ADDR + iOffset)) {
-       // try to read the "WHO_AM_I" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_LSM6DS3_ADDR + iOffset, 0x0f, ucTemp, 1);
-       if (ucTemp[0] == 0x69 || ucTemp[0] == 0x6a) { // normal or "C" variant
-           _iType = IMU_TYPE_LSM6DS3;
-           _iAddr = IMU_LSM6DS3_ADDR + iOffset;
-           _bBigEndian = false;
-           _iStatus = 0x1e; // status register
-           _iAccStart = 0x28;
-           _iGyroStart = 0x22;
-           _iTempStart = 0x20;
-           _iTempLen = 2;
-           _iStepStart = 0x4b;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-           return IMU_SUCCESS;
-       }
-    }
-    
-    if (I2CTest(&_bbi2c, IMU_LIS3DH_ADDR+iOffset)) {
-       // try to read the "WHO_AM_I" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_LIS3DH_ADDR+iOffset, 0x0f, ucTemp, 1);
-       if (ucTemp[0] == 0x33) {
-           _iType = IMU_TYPE_LIS3DH;
-           _iAddr = IMU_LIS3DH_ADDR+iOffset;
-           _iTempStart = 0xc;
-           _iTempLen = 1;
-           _iAccStart = 0x28;
-           _bBigEndian = false;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_LIS3DSH_ADDR+iOffset)) {
-       // try to read the "WHO_AM_I" register
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_LIS3DSH_ADDR+iOffset, 0x0f, ucTemp, 1);
-       if (ucTemp[0] == 0x3F) {
-           _iType = IMU_TYPE_LIS3DSH;
-           _iAddr = IMU_LIS3DSH_ADDR+iOffset;
-           _iTempStart = 0xc;
-           _iTempLen = 1;
-           _iAccStart = 0x28;
-           _bBigEndian = false;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_ADXL345_ADDR+iOffset)) {
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_ADXL345_ADDR+iOffset, 0x0, ucTemp, 1); // get ID
-       if (ucTemp[0] == 0xe5) {
-           _iType = IMU_TYPE_ADXL345;
-           _iAddr = IMU_ADXL345_ADDR+iOffset;
-           _bBigEndian = false;
-           _iAccStart = 0x32;
-           _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_FIFO;
-           return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_BMI160_ADDR+iOffset)) {
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_BMI160_ADDR+iOffset, 0x0, ucTemp, 1); // get ID
-       if (ucTemp[0] == 0xd1) {
-          _iAddr = IMU_BMI160_ADDR+iOffset;
-          _iType = IMU_TYPE_BMI160;
-          _bBigEndian = false;
-          _iAccStart = 0x12;
-          _iGyroStart = 0xc;
-          _iTempStart = 0x20;
-          _iTempLen = 2;
-          _iStepStart = 0x78;
-          _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE | IMU_CAP_PEDOMETER;
-          return IMU_SUCCESS;
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_MPU6050_ADDR+iOffset)) {
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_MPU6050_ADDR+iOffset, 0x75, ucTemp, 1); // get ID
-       if (ucTemp[0] == 0x68) { // MPU6050
-          _iType = IMU_TYPE_MPU6050;
-          _iAddr = IMU_MPU6050_ADDR+iOffset;
-          _bBigEndian = true;
-          _iAccStart = 0x3b;
-          _iGyroStart = 0x43;
-          _iTempStart = 0x41;
-          _iTempLen = 2;
-          _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-          return IMU_SUCCESS;
-       } else if (ucTemp[0] == 0x70) { // MPU6500
-          _iType = IMU_TYPE_MPU6500;
-          _iAddr = IMU_MPU6050_ADDR+iOffset;
-          _bBigEndian = true;
-          _iAccStart = 0x3b;
-          _iGyroStart = 0x43;
-          _iTempStart = 0x41;
-          _iTempLen = 2;
-          _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-          return IMU_SUCCESS;
-       } else {
-      //    Serial.printf("reg 75h returned 0x%02x\n", ucTemp[0]);
-       }
-    }
-    if (I2CTest(&_bbi2c, IMU_MPU6886_ADDR+iOffset)) {
-       ucTemp[0] = 0;
-       I2CReadRegister(&_bbi2c, IMU_MPU6886_ADDR+iOffset, 0x75, ucTemp, 1); // get ID
-       if (ucTemp[0] == 0x19) {
-          _iType = IMU_TYPE_MPU6886;
-          _iAddr = IMU_MPU6886_ADDR+iOffset;
-          _bBigEndian = true;
-          _iAccStart = 0x3b;
-          _iGyroStart = 0x43;
-          _u32Caps = IMU_CAP_ACCELEROMETER | IMU_CAP_GYROSCOPE | IMU_CAP_FIFO | IMU_CAP_TEMPERATURE;
-          return IMU_SUCCESS;
-       }
-    }
-    } // for each address offset
-    return IMU_ERROR;
-} /* init() */
-int BBIMU::getQueuedSamples(int16_t *pSamples, int *iNumSamples, int iMaxSamples)
+//
+// Read up to iMaxSamples timestamped samples from whatever the device
+// offers: with the FIFO enabled (configFIFO()) it is drained, otherwise
+// the output registers are read once. The timestamps use micros().
+// Returns the number of samples or IMU_ERROR
+//
+int BBIMU::getSamples(IMU_SAMPLE *pSamples, int iMaxSamples)
 {
-int16_t *d = (int16_t *)pSamples;
-uint8_t ucTemp[4];
-int i, iNum, iCount;
+int16_t i16Temp[16 * 6];
+int i, k, iCount, iMax, iTotal;
+uint32_t u32Time, u32Period;
 
-    if (_iType == IMU_TYPE_LSM6DS3) {
-        // read the FIFO status
-        if (!I2CReadRegister(&_bbi2c, _iAddr, 0x3a, ucTemp, 4))
-        {
+    IMU_STATS_TIME(IMU_CALL_GETSAMPLES);
+    if (pSamples == NULL || iMaxSamples <= 0) {
+        return 0;
+    }
+    if (!_bFIFO) {
+        memset(pSamples, 0, sizeof(IMU_SAMPLE));
+        if (getSample(pSamples) != IMU_SUCCESS) {
             return IMU_ERROR;
         }
-//        if (ucTemp[1] & 0x10) { // FIFO is empty
-//            *iNumSamples = 0;
-//            return MT_SUCCESS;
-//        }
-        iNum = ucTemp[0] + ((ucTemp[1] & 0xf) << 8); // number of unread 16-bit axis in FIFO (12 bits)
-        if (iNum == 0) {
-            *iNumSamples = 0;
-            return IMU_SUCCESS;
-        }
+        _u32LastStamp = pSamples->timestamp;
+        return 1;
+    }
+    iTotal = 0;
+    do {
+        iMax = iMaxSamples - iTotal;
+        if (iMax > 16) iMax = 16;
         iCount = 0;
-        if (_iMode & MODE_ACCEL) iCount += 3;
-        if (_iMode & MODE_GYRO) iCount += 3;
-        if ((iNum / iCount) > iMaxSamples) {
-            iNum = iCount * iMaxSamples;
+        if (getQueuedSamples(i16Temp, &iCount, iMax) != IMU_SUCCESS) {
+            if (iTotal == 0) return IMU_ERROR;
+            break; // return what we have
         }
-        for (i=0; i<iNum; i++) { // read an even number of samples
-            if (!I2CReadRegister(&_bbi2c, _iAddr, 0x3e, ucTemp, 2))
-            {
-                return IMU_ERROR;
+        for (i=0, k=0; i<iCount; i++) {
+            k += unpackFIFO(&pSamples[iTotal + i], &i16Temp[k]);
+        }
+        iTotal += iCount;
+    } while (iCount == iMax && iTotal < iMaxSamples);
+    // stamp the whole batch against the time the FIFO was emptied
+    // (less what the caller had no room for)
+    u32Time = fifoTime(iTotal, (iTotal == iMaxSamples) ? getFIFOCount() : 0, &u32Period);
+    for (i=0; i<iTotal; i++) {
+        pSamples[i].timestamp = u32Time + (i * u32Period);
+    }
+    return iTotal;
+} /* getSamples() */
+
+//
+// Estimate the I2C bus time (in microseconds at the init() clock) taken
+// to read iSamples samples in the current mode, either from the output
+// registers (the getSample() read plan) or from the FIFO
+// The FIFO is assumed to be drained once per watermark (or once per
+// transport-sized read without one), so its fill level read and the
+// transaction overhead are spread over the samples of that batch.
+// The separate mag die (LSM9DS1) is charged once per mag output period.
+// With u32Channel set, the estimate is for iSamples getOneChannel() calls
+// for that channel instead (0 if the current mode doesn't sample it).
+//
+uint32_t BBIMU::getBusTime(int iSamples, uint32_t u32Channel)
+{
+IMU_FRAME_FORMAT fmt;
+uint64_t u64Bits;
+uint32_t u32Bits;
+int i, iLen, iFrame, iChunk, iBatch, iCount, iRate;
+
+    if (iSamples <= 0) return 0;
+    if (u32Channel != 0) { // one 2-byte register read per call
+        if (channelReg(u32Channel) < 0) return 0;
+        u64Bits = (uint64_t)(IMU_I2C_OVERHEAD + 2*9) * iSamples;
+    } else if (_bFIFO) {
+        iCount = 2; // bytes of the FIFO fill level read
+        if (getFrameFormat(&fmt, false) == IMU_SUCCESS) {
+            iFrame = fmt.u8FrameLen;
+        } else { // BMI160/BMI270 headered frames: 1 header byte + 6 or 12 data bytes
+            iFrame = 1 + ((_iMode & MODE_ACCEL) ? 6 : 0) + ((_iMode & MODE_GYRO) ? 6 : 0);
+        }
+        if (_iType == IMU_TYPE_LSM6DS3) iCount = 4; // FIFO_STATUS1..4
+        else if (_iType == IMU_TYPE_LIS3DH || _iType == IMU_TYPE_LIS3DSH || _iType == IMU_TYPE_ADXL345) iCount = 1;
+        iChunk = (IMU_MAX_I2C_READ / iFrame) * iFrame; // whole frames per read
+        if (iChunk == 0 || _iType == IMU_TYPE_ADXL345) iChunk = iFrame; // the ADXL345 pops one entry per read
+        iBatch = (_iWatermark > 0) ? _iWatermark : iChunk / iFrame;
+        iLen = iBatch * iFrame;
+        if (_iType == IMU_TYPE_BMI270 || _iType == IMU_TYPE_BMI160) iLen += 4; // sensortime frame past the end
+        u32Bits = IMU_I2C_OVERHEAD + iCount*9; // fill level
+        u32Bits += ((iLen + iChunk - 1) / iChunk) * IMU_I2C_OVERHEAD + iLen * 9;
+        u64Bits = ((uint64_t)u32Bits * iSamples) / iBatch;
+    } else {
+        u32Bits = 0;
+        for (i=0; i<_iPlanCount; i++) {
+            u32Bits += IMU_I2C_OVERHEAD + _ucPlanLen[i] * 9;
+        }
+        u64Bits = (uint64_t)u32Bits * iSamples;
+        if (_iMode & MODE_MAG && _iMagAddr != 0) { // the mag die is only read once per its period
+            u32Bits = IMU_I2C_OVERHEAD + 6*9;
+            iRate = (_iMode & MODE_ACCEL) ? _iAccRate : _iGyroRate;
+            if (iRate > 0 && _u32MagPeriod != 0 && (uint64_t)iRate * _u32MagPeriod > 1000000) {
+                u64Bits += ((uint64_t)u32Bits * iSamples * 1000000) / ((uint64_t)iRate * _u32MagPeriod);
+            } else { // mag as fast as the samples
+                u64Bits += (uint64_t)u32Bits * iSamples;
             }
-            *d++ = (int16_t)(ucTemp[0] | (ucTemp[1]<<8));
         }
-        *iNumSamples = iNum / iCount;
     }
+    return (uint32_t)((u64Bits * 1000000) / _u32Speed);
+} /* getBusTime() */
+
+//
+// True if samples come from the FIFO (configFIFO() was called)
+//
+bool BBIMU::usesFIFO(void)
+{
+    return _bFIFO;
+} /* usesFIFO() */
+
+//
+// Return the driver counters collected since the last resetStats()
+// Returns IMU_ERROR (and zeros) if the library was built without BB_IMU_STATS
+//
+int BBIMU::getStats(IMU_STATS *pStats)
+{
+#ifdef BB_IMU_STATS
+    memcpy(pStats, &_stats, sizeof(IMU_STATS));
     return IMU_SUCCESS;
-} /* getQueuedSamples() */
+#else
+    memset(pStats, 0, sizeof(IMU_STATS));
+    return IMU_ERROR;
+#endif
+} /* getStats() */
+
+void BBIMU::resetStats(void)
+{
+#ifdef BB_IMU_STATS
+    memset(&_stats, 0, sizeof(IMU_STATS));
+    _u32StatsHash = 0;
+#endif
+} /* resetStats() */
 
 //
-// Configure the channels used for the FIFO and activate that mode
+// Provide the storage for the interrupt-fed sample ring
+// iSize must be a power of 2
 //
-int BBIMU::configFIFO(void)
+void BBIMU::setRing(IMU_SAMPLE *pRing, int iSize)
 {
-    uint8_t ucEnable, ucTemp[4];
-    int iODR;
+    _pRing = pRing;
+    _u32RingMask = (uint32_t)(iSize - 1);
+    _u32RingHead = _u32RingTail = 0;
+    _u32IRQServiced = _u32IRQCount;
+} /* setRing() */
 
-        if (_iType == IMU_TYPE_LSM6DS3) {
-            // calculate the ODR (output data rate)
-            iODR = 0;
-            if (_iAccRate == 12) {
-                iODR = 1; // 12.5hz low power
-            } else if (_iAccRate == 26) {
-                iODR = 2; // 26hz
-            } else if (_iAccRate == 52) {
-                iODR = 3; // 52hz
-            } else if (_iAccRate == 104) {
-                iODR = 4; // 104hz
-            } else if (_iAccRate == 208) {
-                iODR = 5; // 208hz
-            } else if (_iAccRate == 416) {
-                iODR = 6; // 416hz
-            } else if (_iAccRate == 833) {
-                iODR = 7; // 833hz
-            } else if (_iAccRate == 1660) {
-                iODR = 8; // 1660hz
-            } else if (_iAccRate == 3330) {
-                iODR = 9; // 3330hz
-            } else if (_iAccRate == 6660) {
-                iODR = 10; // 6660hz
-            }
-            // set bypass mode first to reset the FIFO
-            ucTemp[0] = 0x0a; // FIFO_CTRL5
-            ucTemp[1] = 0; // bypass mode (FIFO_MODE [2:0] = 000)
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            // set the FIFO threshold value
-            ucTemp[0] = 6; // FIFO_CTRL1 & FIFO_CTRL2
-            ucTemp[1] = 0; // low byte
-            ucTemp[2] = 8; // high byte (2048 samples)
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+//
+// Read the data signaled by dataReady() into the ring
+// Call this from loop() or a separate task; it is the only writer of the
+// ring head, so it doesn't need to lock against popSamples().
+// With the FIFO enabled (e.g. watermark interrupts), the FIFO is drained
+// into the ring, otherwise a single sample is read.
+// Returns the number of samples added
+//
+int BBIMU::serviceIRQ(void)
+{
+IMU_SAMPLE sTemp, *pSample;
+uint32_t u32Count, u32Head;
+bool bFull;
 
-            // Enable the accelerometer, gyro or both
-            ucEnable = 0;
-            if (_iMode & MODE_ACCEL) {
-                // enable only the requested channels
-//                ucTemp[0] = 0x18; // CTRL9_XL select channels for accelerometer
-//                ucTemp[1] = 0;
-//                if (u32Channels & IMU_CHANNEL_ACC_X) ucTemp[1] |= 8;
-//                if (u32Channels & IMU_CHANNEL_ACC_Y) ucTemp[1] |= 16;
-//                if (u32Channels & IMU_CHANNEL_ACC_Z) ucTemp[1] |= 32;
-//                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-                ucEnable |= 0x01; // enable accelerometer with no decimation
+    u32Count = _u32IRQCount; // snapshot, the ISR may keep counting
+    if (_pRing == NULL || u32Count == _u32IRQServiced) {
+        return 0;
+    }
+    if (_bFIFO) {
+        int16_t i16Temp[16 * 6];
+        int i, k, iCount, iMax, iTotal = 0;
+        uint32_t u32Time, u32Period;
+
+        _u32IRQServiced = u32Count;
+        u32Head = _u32RingHead;
+        do {
+            iMax = (int)(_u32RingMask + 1 - (u32Head + iTotal - _u32RingTail)); // free slots
+            if (iMax > 16) iMax = 16;
+            iCount = 0;
+            if (iMax == 0 || getQueuedSamples(i16Temp, &iCount, iMax) != IMU_SUCCESS) {
+                break; // leave the rest in the FIFO
             }
-            if (_iMode & MODE_GYRO) {
-                // enable only the requested channels
-//                ucTemp[0] = 0x19; // CTRL10_C select channels for gyroscope
-//                ucTemp[1] = 0;
-//                if (u32Channels & IMU_CHANNEL_GYR_X) ucTemp[1] |= 8;
-//                if (u32Channels & IMU_CHANNEL_GYR_Y) ucTemp[1] |= 16;
-//                if (u32Channels & IMU_CHANNEL_GYR_Z) ucTemp[1] |= 32;
-//                I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-                ucEnable |= 0x8; // enable gyroscope with no decimation
+            for (i=0, k=0; i<iCount; i++) {
+                k += unpackFIFO(&_pRing[(u32Head + iTotal + i) & _u32RingMask], &i16Temp[k]);
             }
-            ucTemp[0] = 0x8; // FIFO_CTRL3
-            ucTemp[1] = ucEnable; // enables acc, gyr or both
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            // turn on the FIFO
-            ucTemp[0] = 0x0a; // FIFO_CTRL5
-            ucTemp[1] = (iODR << 3); // FIFO mode enabled
-            ucTemp[1] |= 0x06; // continuous update - old data is tossed as new arrives
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-    //        ucTemp[0] = 0x1a; // MASTR_CONFIG
-    //        ucTemp[1] = 0x00; // start?
-    //        I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            iTotal += iCount;
+        } while (iCount == iMax);
+        // stamp the whole batch against the time the FIFO was emptied
+        // (like getSamples()) before handing it to popSamples(); when the
+        // ring filled up, the newest samples are still in the FIFO
+        u32Time = fifoTime(iTotal, (iMax == iCount) ? getFIFOCount() : 0, &u32Period);
+        for (i=0; i<iTotal; i++) {
+            _pRing[(u32Head + i) & _u32RingMask].timestamp = u32Time + (i * u32Period);
         }
-        return IMU_SUCCESS;
-
-} /* configFIFO() */
+        __sync_synchronize(); // the samples must be visible before the new head
+        _u32RingHead = u32Head + iTotal;
+        return iTotal;
+    }
+    // only the newest data is in the output registers
+    _fifoInfo.iLost += (int)(u32Count - _u32IRQServiced - 1);
+    IMU_STATS_ADD(u32Dropped, u32Count - _u32IRQServiced - 1);
+    _u32IRQServiced = u32Count;
+    u32Head = _u32RingHead;
+    bFull = (u32Head - _u32RingTail) > _u32RingMask;
+    // read the sample even when there's no room, so that the
+    // data-ready signal is cleared and keeps generating edges
+    pSample = (bFull) ? &sTemp : &_pRing[u32Head & _u32RingMask];
+    memset(pSample, 0, sizeof(IMU_SAMPLE));
+    if (getSample(pSample) != IMU_SUCCESS) {
+        return 0;
+    }
+    if (bFull) {
+        _fifoInfo.iLost++;
+        IMU_STATS_ADD(u32Dropped, 1);
+        return 0;
+    }
+    __sync_synchronize(); // the sample must be visible before the new head
+    _u32RingHead = u32Head + 1;
+    return 1;
+} /* serviceIRQ() */
 
 //
-// Read the status register
-// This is usually needed to clear the last interrupt event
+// Remove up to iMaxSamples from the ring without blocking
+// Returns the number of samples copied
 //
-uint8_t BBIMU::getStatus(void)
+int BBIMU::popSamples(IMU_SAMPLE *pSamples, int iMaxSamples)
 {
-    uint8_t uc;
-    I2CReadRegister(&_bbi2c, _iAddr, _iStatus, &uc, 1);
-    return uc;
-} /* getStatus() */
+uint32_t u32Tail, u32Count, i;
 
-int BBIMU::configIRQ(bool bOn)
-{
-uint8_t ucTemp[4];
-    
-    switch (_iType) {
-        case IMU_TYPE_BMI270:
-            break;
-        case IMU_TYPE_LSM6DS3:
-            ucTemp[0] = 0x0d; // INT1_CTRL
-            ucTemp[1] = (bOn) ? 0x03 : 0x00; // INT1_DRDY_G | INT1_DRDY_XL; // data ready acc+gyr
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            break;
-        case IMU_TYPE_MPU6050:
-        case IMU_TYPE_MPU6500:
-            break;
-        case IMU_TYPE_ADXL345:
-            break;
-        case IMU_TYPE_MPU6886:
-            break;
-        case IMU_TYPE_BMI160:
-            break;
-        case IMU_TYPE_LIS3DH:
-        case IMU_TYPE_LIS3DSH:
-           break; // LIS3DH / LIS3DSH
-        case IMU_TYPE_LSM9DS1:
-           break; // LSM9DS1
-        default:
-           return IMU_ERROR;
-    } // switch on type
-    return IMU_SUCCESS;
-} /* configIRQ() */
+    if (_pRing == NULL || iMaxSamples <= 0) {
+        return 0;
+    }
+    u32Tail = _u32RingTail;
+    u32Count = _u32RingHead - u32Tail;
+    __sync_synchronize(); // read the head before the samples it covers
+    if (u32Count > (uint32_t)iMaxSamples) u32Count = (uint32_t)iMaxSamples;
+    for (i=0; i<u32Count; i++) {
+        memcpy(&pSamples[i], &_pRing[(u32Tail + i) & _u32RingMask], sizeof(IMU_SAMPLE));
+    }
+    __sync_synchronize(); // finish copying before handing the slots back
+    _u32RingTail = u32Tail + u32Count;
+    return (int)u32Count;
+} /* popSamples() */
 
 //
 // Start the accelerometer, gyroscope or both
 // with the given sample rate
+// Returns IMU_ERROR if a reset/power-up handshake or the first data-ready
+// doesn't happen in time (the phases seen so far are in getStartupInfo())
 //
 int BBIMU::start(int iSampleRate, int iMode)
 {
-uint8_t ucTemp[4];
-int iRate;
+uint8_t ucTemp[4], ucReady;
+int i, iRate, iTimeout;
+unsigned long ulTime;
 
    _iMode = iMode;
+   _bFIFO = false;
+   memset(&_startupInfo, 0, sizeof(IMU_STARTUP_INFO));
+   _u32LastStamp = 0; // the rate may change
+   _bClockRef = _bClockValid = false;
+   _iClockPPM = 0; // the nominal rate itself may be off
+   _u32ChipUnits = 0;
+   _u32SensorTime = _u32FIFOTime = 0;
+   _u32MagPeriod = _u32MagTime = 0;
+   _i16Mag[0] = _i16Mag[1] = _i16Mag[2] = 0;
+   _iLostRef = _fifoInfo.iLost;
+   ulTime = micros();
    switch (_iType) {
+      case IMU_TYPE_BNO055:
+         // the sensors are configured by the operating mode, which
+         // can only be changed from CONFIG mode
+         if (bnoMode(BNO055_MODE_CONFIG) != IMU_SUCCESS) {
+            return IMU_ERROR;
+         }
+         ucTemp[0] = 0x07; // PAGE_ID
+         ucTemp[1] = 0; // the data and config registers are on page 0
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         ucTemp[0] = 0x3e; // PWR_MODE
+         ucTemp[1] = 0; // normal
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         ucTemp[0] = 0x3b; // UNIT_SEL
+         ucTemp[1] = 0x80; // m/s^2, dps, degrees, C, Android orientation (power-on default)
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         _iAccRate = 62; // power-on defaults of the non-fusion modes
+         _iGyroRate = 32;
+         if (_iMode & MODE_3DPOS) {
+            _iAccRate = _iGyroRate = 100; // fusion output rate (fixed)
+            ucTemp[0] = BNO055_MODE_NDOF; // 9-axis fusion
+         } else {
+            i = 0;
+            if (_iMode & MODE_ACCEL) i |= 1;
+            if (_iMode & MODE_MAG) i |= 2;
+            if (_iMode & MODE_GYRO) i |= 4;
+            ucTemp[0] = bno055_modes[i];
+         }
+         _startupInfo.u32Reset = micros() - ulTime;
+         ulTime = micros();
+         if (bnoMode(ucTemp[0]) != IMU_SUCCESS) {
+            return IMU_ERROR;
+         }
+         break; // BNO055
       case IMU_TYPE_QMI8658:
          ucTemp[0] = 8; // CTRL7
          ucTemp[1] = 0xa4;
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2); // first disable acc+gyro
 
-         if (_iMode & MODE_ACCEL) {
-            iRate = matchRate(_iAccRate, (int16_t *)&qmi8658_accel_rates[0]);
+         _iAccRate = _iGyroRate = iSampleRate;
+         if (_iMode & MODE_ACCEL && !(_iMode & MODE_3DPOS)) {
+            iRate = (iSampleRate <= qmi8658_accel_rates[0]) ? 0 : 1+matchRate(iSampleRate, (int16_t *)&qmi8658_accel_rates[0]);
+            if (iRate > 5) iRate = 5; // 1000Hz
+            _iAccRate = qmi8658_accel_rates[iRate]; // get the quantized value
             iRate = (8-iRate) & 0xf; // reverse order
             ucTemp[0] = 3; // CTRL2 (accel control)
             ucTemp[1] = iRate | (_iAccScale << 4); // enable accel +/-2/4/8/16g full scale
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2); 
          }
-         if (_iMode & MODE_GYRO) {
-            iRate = matchRate(_iAccRate, (int16_t *)&qmi8658_gyro_rates[0]);
+         if (_iMode & MODE_GYRO && !(_iMode & MODE_3DPOS)) {
+            iRate = (iSampleRate <= qmi8658_gyro_rates[0]) ? 0 : 1+matchRate(iSampleRate, (int16_t *)&qmi8658_gyro_rates[0]);
+            if (iRate > 8) iRate = 8; // 7520Hz
+            // with the gyroscope on, the accelerometer runs at its rate
+            _iAccRate = _iGyroRate = qmi8658_gyro_rates[iRate];
             iRate = (8-iRate) & 0xf; // reverse order
             ucTemp[0] = 4; // CTRL3 (gyro control)
             ucTemp[1] = iRate | 0x30; // full scale +/-128 dps
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          } 
+         if (_iMode & MODE_3DPOS) {
+            // The AttitudeEngine integrates the accel/gyro data at a high internal
+            // rate and outputs quaternion (dQ) and velocity (dV) increments at 1-64Hz
+            iRate = matchRate(iSampleRate, &qmi8658_ae_rates[0]);
+            if (iRate > 6) iRate = 6;
+            _iAccRate = _iGyroRate = qmi8658_ae_rates[iRate + 1]; // samples arrive at the AE rate
+            ucTemp[0] = 7; // CTRL6
+            ucTemp[1] = (uint8_t)iRate; // sODR, motion on demand disabled
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         }
          ucTemp[0] = 8; // CTRL7
          ucTemp[1] = 0xa4;
          if (_iMode & MODE_GYRO) ucTemp[1] |= 2; // enable gyro
          if (_iMode & MODE_ACCEL) ucTemp[1] |= 1; // enable accel
+         if (_iMode & MODE_3DPOS) ucTemp[1] |= (8 | 2 | 1); // AttitudeEngine needs both sensors
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          break;
       case IMU_TYPE_BMI270:
-         ucTemp[0] = 0x7e; // CMD_REG_ADDR
-         ucTemp[1] = 0xb6; // SOFT_RESET_CMD
-         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         delay(100);
-         ucTemp[0] = 0x7c; // power configuration
-         ucTemp[1] = 0; // pwr save disabled
-         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         delay(4);
- //        ucTemp[0] = 0x5b; // INIT_ADDR_0
- //        ucTemp[1] = 0x00;
- //        ucTemp[2] = 0x00;
- //        I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
-         I2CWrite(&_bbi2c, _iAddr, (uint8_t *)bmi270_config_file, sizeof(bmi270_config_file));
-         ucTemp[0] = 0x59; // INIT_CTRL
-         ucTemp[1] = 1; // start initialization
-         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-//         ucTemp[0] = 0x58; // INT_MAP_DATA_ADDR
-//         ucTemp[1] = 0xff;
-//         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         delay(100);
+         ucTemp[0] = 0;
+         I2CReadRegister(&_bbi2c, _iAddr, 0x21, ucTemp, 1); // INTERNAL_STATUS
+         if ((ucTemp[0] & 0x0f) != 0x01) { // not init_ok, reset and load the config
+            ucTemp[0] = 0x7e; // CMD_REG_ADDR
+            ucTemp[1] = 0xb6; // SOFT_RESET_CMD
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            delay(2); // the soft reset takes 2ms (CHIP_ID reads back before it is done)
+            ucTemp[0] = 0x7c; // power configuration
+            ucTemp[1] = 0; // pwr save disabled
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            delayMicroseconds(450); // required before the config upload
+            if (bmi270Upload() != IMU_SUCCESS) {
+               return IMU_ERROR;
+            }
+         } else { // warm start - the config is still loaded
+            ucTemp[0] = 0x7c; // power configuration
+            ucTemp[1] = 0; // pwr save disabled
+            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         }
+         _startupInfo.u32Reset = micros() - ulTime;
+         ulTime = micros();
          // set rate and range
          _iAccRate = iSampleRate;
          iRate = 1+matchRate(_iAccRate, &bmi270_rates[0]); 
@@ -530,66 +2401,78 @@ int iRate;
          ucTemp[0] = 0x1c; // ACCEL_CONFIG
          ucTemp[1] = (_iAccScale << 3); // +/- 2/4/8/16g range
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         // 1khz internal rate (DLPF on) divided down to the requested rate
+         iRate = (iSampleRate > 0) ? (1000 / iSampleRate) - 1 : 0;
+         if (iRate < 0) iRate = 0;
+         else if (iRate > 255) iRate = 255;
+         _iAccRate = _iGyroRate = 1000 / (iRate + 1);
+         ucTemp[0] = 0x19; // SMPLRT_DIV
+         ucTemp[1] = (uint8_t)iRate;
+         ucTemp[2] = 1; // CONFIG: DLPF_CFG = 1
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
          break; // MPU6050
       case IMU_TYPE_ADXL345:
+         _iAccRate = iSampleRate;
+         iRate = 1 + matchRate(_iAccRate, &adxl345_rates[0]);
+         if (iRate > 10) iRate = 10; // 3200Hz is the fastest rate code
+         _iAccRate = adxl345_rates[iRate]; // get the quantized value
          ucTemp[0] = 0x2c; // bandwidth/rate mode
-         ucTemp[1] = 0x06; // 6.125hz sampling (lowest power)
+         ucTemp[1] = iRate + 5; // rate code 6 = 6.25hz ... 15 = 3200hz
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+         ucTemp[0] = 0x31; // data format
+         ucTemp[1] = 0x08 | _iAccScale; // full resolution (4mg/LSB), right justified, +/-2/4/8/16g range
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          ucTemp[0] = 0x2d; // power control
          ucTemp[1] = 0x08; // set simplest sampling mode (only measure bit)
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         ucTemp[0] = 0x31; // data format
-         ucTemp[1] = 0x00; // set +/-2g range and right justified mode
-         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          break; // ADXL345
       case IMU_TYPE_MPU6886:
             ucTemp[0] = 0x6b; // PWR_MGMT_1
             ucTemp[1] = 0x00;
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(10);
 
             ucTemp[1] = 0x80; // reset chip
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(10);
+            if (waitReg(0x6b, 0x80, 0x00, 100) != IMU_SUCCESS) { // DEVICE_RESET self-clears
+               return IMU_ERROR;
+            }
+            _startupInfo.u32Reset = micros() - ulTime;
+            ulTime = micros();
+            ucTemp[0] = 0x6b; // PWR_MGMT_1
             ucTemp[1] = 1; // select the best available oscillator
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(10);
+            waitReg(0x6b, 0x47, 0x01, 10); // awake with the new clock source
             ucTemp[0] = 0x1c; // ACCEL_CONFIG
             ucTemp[1] = (_iAccScale << 3); // set scale, all axes enabled
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x1b; // GYRO_CONFIG
             ucTemp[1] = 0x18; // +/- 2000 degrees per second
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x1a; // CONFIG
             ucTemp[1] = 1; // 176 filtered samples per sec (1k sampling rate)
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
+            iRate = (iSampleRate > 0) ? (1000 / iSampleRate) - 1 : 0;
+            if (iRate < 0) iRate = 0;
+            else if (iRate > 255) iRate = 255;
+            _iAccRate = _iGyroRate = 1000 / (iRate + 1);
             ucTemp[0] = 0x19; // SMPLRT_DIV
-            ucTemp[1] = 0x05; // sample rate divider (1000 / (1+this_val))
+            ucTemp[1] = (uint8_t)iRate; // sample rate divider (1000 / (1+this_val))
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x38; // INT_ENABLE
             ucTemp[1] = 0x00; // disable interrupts
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x1d; // ACCEL_CONFIG2
             ucTemp[1] = 0x00; // avg 4 samples
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x6a; // USER_CTRL
             ucTemp[1] = 0x00; // disable FIFO
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x23; // FIFO_EN
             ucTemp[1] = 0x00; // disable
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            delay(1);
             ucTemp[0] = 0x37; // INT_PIN_CFG
             ucTemp[1] = 0x22; // latch int enable
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-//            delay(1);
 //            ucTemp[0] = 0x38; // INT_ENABLE
 //            ucTemp[1] = 0x01; // enable interrupt on data ready
 //            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
@@ -598,12 +2481,29 @@ int iRate;
          ucTemp[0] = 0x7e; // send command
          ucTemp[1] = 0x11; // set accelerometer to normal mode
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         delay(4); // give it 4ms to occur
+         // the next command is ignored until this one has finished
+         waitReg(0x03, 0x30, 0x10, 10); // PMU_STATUS: acc_pmu_status = normal
          ucTemp[0] = 0x7e; // command
          ucTemp[1] = 0x15; // set gyroscope to normal power mode
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-         ucTemp[0] = 0x41; // ACC_RANGE
-         ucTemp[1] = bmi160_scales[_iAccScale];
+         if (waitReg(0x03, 0x0c, 0x04, 100) != IMU_SUCCESS) { // gyr_pmu_status = normal (up to 80ms)
+            return IMU_ERROR;
+         }
+         // same rate encoding as the BMI270 (accel max = 1600hz)
+         _iAccRate = iSampleRate;
+         iRate = 1+matchRate(_iAccRate, &bmi270_rates[0]);
+         if (iRate > 12) iRate = 12;
+         _iAccRate = _iGyroRate = bmi270_rates[iRate]; // get the quantized value
+         ucTemp[0] = 0x40; // ACC_CONF (0x41 = ACC_RANGE)
+         ucTemp[1] = 0x20 | iRate; // normal filter mode + ODR
+         ucTemp[2] = bmi160_scales[_iAccScale];
+         I2CWrite(&_bbi2c, _iAddr, ucTemp, 3);
+         if (iRate < 6) { // gyro min = 25hz
+            iRate = 6;
+            _iGyroRate = bmi270_rates[iRate];
+         }
+         ucTemp[0] = 0x42; // GYR_CONF
+         ucTemp[1] = 0x20 | iRate;
          I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          if (_iMode & MODE_STEP) {
              ucTemp[0] = 0x7a; // STEP_CONF
@@ -618,18 +2518,31 @@ int iRate;
       case IMU_TYPE_LIS3DH:
       case IMU_TYPE_LIS3DSH:
          if (_iMode & MODE_ACCEL) {
-            ucTemp[0] = 0x20; // CTRL_REG1
-            ucTemp[1] = (6 << 4); // 100Hz iODR << 4;
-            // Enable only the requested channels
-            ucTemp[1] |= (1 | 2 | 4); // activate all channels
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
-            ucTemp[0] = 0x24; // CTRL_REG5
-            ucTemp[1] = (lis3dsh_scales[_iAccScale] << 3);
-            I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            _iAccRate = iSampleRate;
+            if (_iType == IMU_TYPE_LIS3DH) {
+               iRate = 1 + matchRate(_iAccRate, &lis3dh_rates[0]);
+               _iAccRate = lis3dh_rates[iRate]; // get the quantized value
+               if (iRate == 8) iRate = 9; // 1344hz (ODR 8 is low-power only)
+               ucTemp[0] = 0x20; // CTRL_REG1
+               ucTemp[1] = (iRate << 4);
+               // Enable only the requested channels
+               ucTemp[1] |= (1 | 2 | 4); // activate all channels
+               I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+               ucTemp[0] = 0x23; // CTRL_REG4
+               ucTemp[1] = 0x88 | (_iAccScale << 4); // BDU & high res mode enabled + full scale
+               I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            } else { // LIS3DSH
+               iRate = 1 + matchRate(_iAccRate, &lis3dsh_rates[0]);
+               _iAccRate = lis3dsh_rates[iRate]; // get the quantized value
+               ucTemp[0] = 0x20; // CTRL_REG4
+               ucTemp[1] = (iRate << 4) | 8; // ODR + BDU
+               ucTemp[1] |= (1 | 2 | 4); // activate all channels
+               I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+               ucTemp[0] = 0x24; // CTRL_REG5
+               ucTemp[1] = (lis3dsh_scales[_iAccScale] << 3);
+               I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
+            }
          } // accelerometer enabled
-         ucTemp[0] = 0x23; // CTRL_REG4
-         ucTemp[1] = 0x88; // BDU & high res mode enabled
-         I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          break; // LIS3DH / LIS3DSH
       case IMU_TYPE_LSM9DS1:
          if (_iMode & MODE_ACCEL) {
@@ -637,10 +2550,49 @@ int iRate;
             ucTemp[1] = 0x80 | (lsm6ds3_scales[_iAccScale] << 3); // +/- 2/4/8/16g range, output rate 238Hz
             I2CWrite(&_bbi2c, _iAddr, ucTemp, 2);
          }
+         if (_iMode & MODE_MAG && _iMagAddr != 0) {
+            // slowest ODR (0.625Hz << n) which keeps up with the sample rate, 80Hz max
+            iRate = 0;
+            while (iRate < 7 && (625L << iRate) < (long)iSampleRate * 1000) iRate++;
+            _u32MagPeriod = 1000000000UL / (625UL << iRate);
+            ucTemp[0] = 0x20; // CTRL_REG1_M
+            ucTemp[1] = 0xe0 | (iRate << 2); // temperature compensated, X/Y ultra-high performance, ODR
+            I2CWrite(&_bbi2c, _iMagAddr, ucTemp, 2);
+            ucTemp[0] = 0x21; // CTRL_REG2_M
+            ucTemp[1] = 0x00; // +/- 4 gauss
+            I2CWrite(&_bbi2c, _iMagAddr, ucTemp, 2);
+            ucTemp[0] = 0x23; // CTRL_REG4_M
+            ucTemp[1] = 0x0c; // Z ultra-high performance
+            I2CWrite(&_bbi2c, _iMagAddr, ucTemp, 2);
+            ucTemp[0] = 0x24; // CTRL_REG5_M
+            ucTemp[1] = 0x40; // block data update (X/Y/Z from the same conversion)
+            I2CWrite(&_bbi2c, _iMagAddr, ucTemp, 2);
+            ucTemp[0] = 0x22; // CTRL_REG3_M
+            ucTemp[1] = 0x00; // continuous conversion
+            I2CWrite(&_bbi2c, _iMagAddr, ucTemp, 2);
+         }
          break; // LSM9DS1
       default:
          return IMU_ERROR;
    } // switch
+   _startupInfo.u32PowerUp = micros() - ulTime;
+   planReads();
+   setAccSensitivity();
+   // Wait for the first new sample of the enabled sensors instead of a
+   // fixed settling delay; allow 2 sample periods past the startup time
+   ucReady = 0;
+   if (_iMode & MODE_ACCEL) ucReady |= _ucAccReady;
+   if (_iMode & MODE_GYRO) ucReady |= _ucGyroReady;
+   if (_iMode & MODE_3DPOS && _iType == IMU_TYPE_QMI8658) ucReady = 0x08; // STATUS0 sDA (AttitudeEngine)
+   if (ucReady) {
+      iTimeout = IMU_START_TIMEOUT;
+      if (iSampleRate > 0) iTimeout += 2000 / iSampleRate;
+      ulTime = micros();
+      if (waitReg((uint8_t)_iStatus, ucReady, ucReady, iTimeout) != IMU_SUCCESS) {
+         return IMU_ERROR; // the sensors never produced a sample (u32FirstData stays 0)
+      }
+      _startupInfo.u32FirstData = micros() - ulTime;
+   }
    return IMU_SUCCESS;
 } /* start() */
 int BBIMU::reset(void)
@@ -717,63 +2669,199 @@ int16_t i;
    return i;
 } /* get16Bits() */
 //
-// Get a single channel's accelerometer or gyroscope sample
-// This can speed up access if you just need to read 1 channel
+// Register getOneChannel() reads for a channel, -1 if the current mode
+// doesn't sample it
 //
-int16_t BBIMU::getOneChannel(uint32_t u32Channel)
+int BBIMU::channelReg(uint32_t u32Channel)
 {
-    int iOff = 0;
-    uint8_t ucTemp[4] = {0};
-    
+int iReg = -1;
+
     if ((_iMode & MODE_ACCEL) && (_u32Caps & IMU_CAP_ACCELEROMETER) && (u32Channel & (IMU_CHANNEL_ACC_X | IMU_CHANNEL_ACC_Y | IMU_CHANNEL_ACC_Z))) { // read accelerometer info
-        iOff = _iAccStart;
-        if (u32Channel & IMU_CHANNEL_ACC_Y) iOff += 2;
-        else if (u32Channel & IMU_CHANNEL_ACC_Z) iOff += 4;
+        iReg = _iAccStart;
+        if (u32Channel & IMU_CHANNEL_ACC_Y) iReg += 2;
+        else if (u32Channel & IMU_CHANNEL_ACC_Z) iReg += 4;
+    } else if ((_iMode & MODE_GYRO) && (_u32Caps & IMU_CAP_GYROSCOPE) && (u32Channel & (IMU_CHANNEL_GYR_X | IMU_CHANNEL_GYR_Y | IMU_CHANNEL_GYR_Z))) { // read gyroscope info
+        iReg = _iGyroStart;
+        if (u32Channel & IMU_CHANNEL_GYR_Y) iReg += 2;
+        else if (u32Channel & IMU_CHANNEL_GYR_Z) iReg += 4;
     }
-    if ((_iMode & MODE_GYRO) && (_u32Caps & IMU_CAP_ACCELEROMETER) && (u32Channel & (IMU_CHANNEL_ACC_X | IMU_CHANNEL_ACC_Y | IMU_CHANNEL_ACC_Z))) { // read accelerometer info
-        iOff = _iGyroStart;
-        if (u32Channel & IMU_CHANNEL_GYR_Y) iOff += 2;
-        else if (u32Channel & IMU_CHANNEL_GYR_Z) iOff += 4;
+    if (iReg >= 0 && _iType == IMU_TYPE_LIS3DH) { // the register MSB enables auto-increment
+        iReg |= 0x80;
     }
-    
-    I2CReadRegister(&_bbi2c, _iAddr, iOff, ucTemp, 2);
+    return iReg;
+} /* channelReg() */
+
+//
+// Get a single channel's accelerometer or gyroscope sample
+// This can speed up access if you just need to read 1 channel
+// Returns 0 without reading if the current mode doesn't sample it
+//
+int16_t BBIMU::getOneChannel(uint32_t u32Channel)
+{
+uint8_t ucTemp[4] = {0};
+int iReg;
+
+    iReg = channelReg(u32Channel);
+    if (iReg < 0) return 0;
+    I2CReadRegister(&_bbi2c, _iAddr, (uint8_t)iReg, ucTemp, 2);
     return get16Bits(ucTemp);
 } /* getOneChannel() */
 
+//
+// Work out the fewest register windows which cover the values needed
+// by the current mode; called by start(). Values are sorted by register
+// address and merged when they overlap or are separated by a small gap,
+// as long as the window fits in one I2C read. The offset of each value
+// within the concatenated windows is kept for getSample().
+//
+void BBIMU::planReads(void)
+{
+uint8_t ucReg[8], ucLen[8], uc;
+int *pOff[8], *pi;
+int i, j, n, iTotal, iEnd;
+
+    _iAccOff = _iGyroOff = _iTempOff = _iStepOff = _iStatusOff = _iTimeOff = _iQuatOff = _iMagOff = -1;
+    n = 0;
+    if (_iMode & MODE_ACCEL && _u32Caps & IMU_CAP_ACCELEROMETER) {
+        ucReg[n] = _iAccStart; ucLen[n] = 6; pOff[n++] = &_iAccOff;
+    }
+    if (_iMode & MODE_GYRO && _u32Caps & IMU_CAP_GYROSCOPE) {
+        ucReg[n] = _iGyroStart; ucLen[n] = 6; pOff[n++] = &_iGyroOff;
+    }
+    if (_iMode & MODE_MAG && _iMagStart != 0) { // on the same die (BNO055), read with acc/gyro
+        ucReg[n] = _iMagStart; ucLen[n] = 6; pOff[n++] = &_iMagOff;
+    }
+    if (_iMode & MODE_TEMP && _u32Caps & IMU_CAP_TEMPERATURE) {
+        ucReg[n] = _iTempStart; ucLen[n] = _iTempLen; pOff[n++] = &_iTempOff;
+    }
+    if (_iMode & MODE_STEP && _u32Caps & IMU_CAP_PEDOMETER) {
+        ucReg[n] = _iStepStart; ucLen[n] = 2; pOff[n++] = &_iStepOff;
+    }
+    if (_iMode & MODE_STATUS && _iStatus != 0) {
+        ucReg[n] = _iStatus; ucLen[n] = 1; pOff[n++] = &_iStatusOff;
+    }
+    if (_iMode & (MODE_ACCEL | MODE_GYRO) && _iTimeStart != 0) { // follows the data registers
+        ucReg[n] = _iTimeStart; ucLen[n] = 3; pOff[n++] = &_iTimeOff;
+    }
+    if (_iMode & MODE_3DPOS && _iQuatStart != 0) {
+        ucReg[n] = _iQuatStart; ucLen[n] = _iQuatLen; pOff[n++] = &_iQuatOff;
+    }
+    for (i=1; i<n; i++) { // insertion sort by register address
+        for (j=i; j>0 && ucReg[j-1] > ucReg[j]; j--) {
+            uc = ucReg[j]; ucReg[j] = ucReg[j-1]; ucReg[j-1] = uc;
+            uc = ucLen[j]; ucLen[j] = ucLen[j-1]; ucLen[j-1] = uc;
+            pi = pOff[j]; pOff[j] = pOff[j-1]; pOff[j-1] = pi;
+        }
+    }
+    _iPlanCount = 0;
+    iTotal = 0; // bytes read by the windows so far
+    for (i=0; i<n; i++) {
+        j = _iPlanCount - 1;
+        iEnd = ucReg[i] + ucLen[i]; // 1 past the last register
+        if (j >= 0 && ucReg[i] <= _ucPlanReg[j] + _ucPlanLen[j] + IMU_READ_GAP &&
+            iEnd - _ucPlanReg[j] <= IMU_MAX_I2C_READ) { // extend the last window
+            *pOff[i] = iTotal - _ucPlanLen[j] + (ucReg[i] - _ucPlanReg[j]);
+            if (iEnd - _ucPlanReg[j] > _ucPlanLen[j]) {
+                iTotal += (iEnd - _ucPlanReg[j]) - _ucPlanLen[j];
+                _ucPlanLen[j] = (uint8_t)(iEnd - _ucPlanReg[j]);
+            }
+        } else { // start a new window
+            _ucPlanReg[_iPlanCount] = ucReg[i];
+            _ucPlanLen[_iPlanCount++] = ucLen[i];
+            *pOff[i] = iTotal;
+            iTotal += ucLen[i];
+        }
+    }
+    if (_iType == IMU_TYPE_LIS3DH) { // the register MSB enables auto-increment
+        for (i=0; i<_iPlanCount; i++) {
+            if (_ucPlanLen[i] > 1) _ucPlanReg[i] |= 0x80;
+        }
+    }
+} /* planReads() */
+
 //
 // Read an accel, gyro, and temp sample depending on the operating mode
+// using the register windows prepared by planReads()
+// A separate magnetometer die (LSM9DS1) is read right after the
+// accel/gyro windows, but only once per mag output period since it
+// updates more slowly; in between, the last mag values are repeated
+// with magFresh = 0, so they are not time-aligned with the sample
 //
 int BBIMU::getSample(IMU_SAMPLE *pSample)
 {
-uint8_t ucTemp[16];
-int i;
+uint8_t ucTemp[IMU_PLAN_SIZE];
+int i, iOff;
+#ifdef BB_IMU_STATS
+int j;
+#endif
 
-     if (_iMode == (MODE_ACCEL | MODE_GYRO) && (_iType == IMU_TYPE_BMI160 || _iType == IMU_TYPE_BMI270)) { // we can read the accel+gyro together to reduce the latency
-        I2CReadRegister(&_bbi2c, _iAddr, _iAccStart, ucTemp, 12);
+     IMU_STATS_TIME(IMU_CALL_GETSAMPLE);
+     for (i=0, iOff=0; i<_iPlanCount; i++) {
+        if (!I2CReadRegister(&_bbi2c, _iAddr, _ucPlanReg[i], &ucTemp[iOff], _ucPlanLen[i])) {
+           return IMU_ERROR;
+        }
+        iOff += _ucPlanLen[i];
+     }
+#ifdef BB_IMU_STATS
+     { // only the sensor outputs; status, temperature and sensortime change without a new sample
+        const int iHashOff[4] = {_iAccOff, _iGyroOff, _iMagOff, _iQuatOff};
+        const int iHashLen[4] = {6, 6, 6, _iQuatLen};
+        uint32_t u32Hash = 0;
+        for (j=0; j<4; j++) {
+           if (iHashOff[j] < 0) continue;
+           for (i=0; i<iHashLen[j]; i++) u32Hash = (u32Hash * 31) + ucTemp[iHashOff[j] + i];
+        }
+        if (_stats.u32Delivered != 0 && u32Hash == _u32StatsHash) _stats.u32Duplicates++;
+        _u32StatsHash = u32Hash;
+        _stats.u32Delivered++;
+     }
+#endif
+     pSample->timestamp = micros();
+     if (_iMode & MODE_MAG && _iMagAddr != 0) {
+        if (_u32MagTime == 0 || pSample->timestamp - _u32MagTime >= _u32MagPeriod) {
+           // the sub-address MSB enables auto-increment on the mag die
+           if (!I2CReadRegister(&_bbi2c, _iMagAddr, 0x28 | 0x80, &ucTemp[iOff], 6)) { // OUT_X_L_M
+              return IMU_ERROR;
+           }
+           for (i=0; i<3; i++) {
+              _i16Mag[i] = (int16_t)(ucTemp[iOff + i*2] | (ucTemp[iOff + i*2 + 1] << 8));
+           }
+           // the mag die's X axis points the other way from the accel/gyro X
+           // (datasheet pin 1 figure); Y and Z match, so flip X into that frame
+           _i16Mag[0] = (_i16Mag[0] == -32768) ? 32767 : -_i16Mag[0];
+           _u32MagTime = pSample->timestamp;
+           pSample->magFresh = 1;
+        } else {
+           pSample->magFresh = 0; // repeats the last reading
+        }
+        memcpy(pSample->mag, _i16Mag, sizeof(_i16Mag));
+     } else if (_iMagOff >= 0) {
         for (i=0; i<3; i++) {
-           pSample->accel[i] = get16Bits(&ucTemp[i*2]);
-           pSample->gyro[i] = get16Bits(&ucTemp[(i*2)+6]);
+           pSample->mag[i] = get16Bits(&ucTemp[_iMagOff + i*2]);
         }
-        return IMU_SUCCESS;
+        pSample->magFresh = 1;
+     } else {
+        memset(pSample->mag, 0, sizeof(pSample->mag));
+        pSample->magFresh = 0;
+     }
+     if (_iTimeOff >= 0) { // place it on the sensor's own sample grid
+        pSample->timestamp = sensorTime(ucTemp[_iTimeOff] | (ucTemp[_iTimeOff+1] << 8) | ((uint32_t)ucTemp[_iTimeOff+2] << 16), pSample->timestamp);
      }
-     if (_iMode & MODE_ACCEL && _u32Caps & IMU_CAP_ACCELEROMETER) { // read accelerometer info
-        I2CReadRegister(&_bbi2c, _iAddr, _iAccStart, ucTemp, 6);
+     if (_iAccOff >= 0) {
         for (i=0; i<3; i++) { 
-           pSample->accel[i] = get16Bits(&ucTemp[i*2]);
+           pSample->accel[i] = get16Bits(&ucTemp[_iAccOff + i*2]);
         }
      }
-     if (_iMode & MODE_GYRO && _u32Caps & IMU_CAP_GYROSCOPE) { // read gyroscope info
-        I2CReadRegister(&_bbi2c, _iAddr, _iGyroStart, ucTemp, 6);
+     if (_iGyroOff >= 0) {
         for (i=0; i<3; i++) {
-           pSample->gyro[i] = get16Bits(&ucTemp[i*2]);
+           pSample->gyro[i] = get16Bits(&ucTemp[_iGyroOff + i*2]);
         }
      }
-     if (_iMode & MODE_TEMP && _u32Caps & IMU_CAP_TEMPERATURE) { // read the temperature
-        I2CReadRegister(&_bbi2c, _iAddr, _iTempStart, ucTemp, _iTempLen);
+     if (_iTempOff >= 0) {
         if (_iTempLen == 1) {
-           pSample->temperature = (int)((int8_t)ucTemp[0]) * 10;
+           pSample->temperature = (int)((int8_t)ucTemp[_iTempOff]) * 10;
         } else { // two byte temperature value
-           i = get16Bits(ucTemp);
+           i = get16Bits(&ucTemp[_iTempOff]);
            if (_iType == IMU_TYPE_LSM6DS3)
               pSample->temperature = 250 + ((i * 160)/16);
            else if (_iType == IMU_TYPE_MPU6050 || _iType == IMU_TYPE_MPU6500)
@@ -784,9 +2872,21 @@ int i;
               pSample->temperature = 250 + ((i * 10)/16);
         }
      }
-     if (_iMode & MODE_STEP && _u32Caps & IMU_CAP_PEDOMETER) { // read step count
-        I2CReadRegister(&_bbi2c, _iAddr, _iStepStart, ucTemp, 2);
-        pSample->steps = get16Bits(ucTemp);
+     if (_iStepOff >= 0) {
+        pSample->steps = get16Bits(&ucTemp[_iStepOff]);
+     }
+     if (_iStatusOff >= 0) {
+        pSample->status = ucTemp[_iStatusOff];
+     }
+     if (_iQuatOff >= 0) { // w, x, y, z then the QMI8658 velocity increments
+        for (i=0; i<4; i++) {
+           pSample->quat[i] = get16Bits(&ucTemp[_iQuatOff + i*2]);
+        }
+        if (_iQuatLen > 8) {
+           for (i=0; i<3; i++) {
+              pSample->dv[i] = get16Bits(&ucTemp[_iQuatOff + 8 + i*2]);
+           }
+        }
      }
      return IMU_SUCCESS;
 } /* getSample() */
@@ -19,8 +19,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifdef ARDUINO
 #include <Arduino.h>
 #include <BitBang_I2C.h>
+#else // host build, see bb_imu_host.h
+#include "bb_imu_host.h"
+#endif
 
 #ifndef __BB_IMU__
 #define __BB_IMU__
@@ -40,8 +44,80 @@ typedef struct _tagsample
    int16_t gyro[3];
    int temperature;
    int steps;
+   uint8_t status; // status register (MODE_STATUS)
+   uint32_t timestamp; // micros() when the sample was captured (from the sensortime on BMI160/BMI270)
+   int16_t quat[4]; // MODE_3DPOS: w, x, y, z (16384 = 1.0); orientation on the BNO055,
+                    // rotation since the previous sample (dQ) on the QMI8658
+   int16_t dv[3]; // MODE_3DPOS on the QMI8658: velocity increment (dV) since the previous sample
+   int16_t mag[3]; // MODE_MAG: LSM9DS1 0.14 mgauss/LSB (+/-4 gauss), BNO055 16 LSB = 1uT
+                   // in the accel/gyro axes
+   uint8_t magFresh; // MODE_MAG: 1 = mag[] was read with this sample, 0 = repeats an older reading
 } IMU_SAMPLE;
 
+// A device found by scan()
+typedef struct _tagimudevice
+{
+   uint8_t u8Type; // IMU_TYPE_xxx
+   uint8_t u8Addr; // I2C address
+} IMU_DEVICE;
+
+// Extra information gathered while draining the FIFO
+typedef struct _tagfifoinfo
+{
+   uint32_t u32SensorTime; // last sensortime frame (BMI160/BMI270, 39.0625us ticks)
+   int iLost; // samples lost to overflow or skipped frames (cumulative)
+   int iConfigChanges; // config change frames seen (BMI160/BMI270)
+} IMU_FIFO_INFO;
+
+// Driver counters (getStats()), collected when the library is built
+// with BB_IMU_STATS defined (for every file); otherwise they cost nothing
+enum {
+   IMU_CALL_GETSAMPLE=0,
+   IMU_CALL_GETSAMPLES,
+   IMU_CALL_QUEUED, // getQueuedSamples()
+   IMU_CALL_COUNT
+};
+#define IMU_STATS_BUCKETS 8 // bucket n counts calls shorter than (64 << n) us, the last one the rest
+typedef struct _tagstats
+{
+   uint32_t u32Transactions; // I2C reads and writes
+   uint32_t u32Bytes; // bytes on the wire (addresses, registers and data)
+   uint32_t u32Errors; // failed transactions (NACK)
+   uint32_t u32Overflows; // FIFO overflow/overrun events
+   uint32_t u32Delivered; // samples read from the chip
+   uint32_t u32Dropped; // samples lost (FIFO overflow, missed data-ready, full ring)
+   uint32_t u32Duplicates; // getSample() read the same data as the time before
+   uint32_t u32Latency[IMU_CALL_COUNT][IMU_STATS_BUCKETS]; // call durations
+} IMU_STATS;
+
+// Time spent in each phase of start() in microseconds
+typedef struct _tagstartupinfo
+{
+   uint32_t u32Reset; // soft reset and config load (0 if the chip wasn't reset)
+   uint32_t u32PowerUp; // configuration and sensor power-up
+   uint32_t u32FirstData; // until the first data-ready (0 = none to wait for, or start() timed out)
+} IMU_STARTUP_INFO;
+
+// BNO055 on-chip fusion outputs (getFusion())
+typedef struct _tagfusion
+{
+   int16_t euler[3]; // heading, roll, pitch (16 LSB = 1 degree)
+   int16_t quat[4]; // w, x, y, z (16384 = 1.0)
+   int16_t linear[3]; // acceleration without gravity (100 LSB = 1 m/s^2)
+   int16_t gravity[3]; // gravity vector (100 LSB = 1 m/s^2)
+   uint8_t calib; // CALIB_STAT (see getCalibStatus())
+} IMU_FUSION;
+
+// Layout of 16-bit sample frames for the batch decode kernels
+typedef struct _tagframeformat
+{
+   uint8_t u8FrameLen; // bytes per frame
+   uint8_t u8Acc, u8Gyro; // offset of the X value in the frame (0xff = not present)
+   uint8_t bBigEndian; // byte order of the values
+   float fAccScale; // g per LSB
+   float fGyroScale; // degrees per second per LSB
+} IMU_FRAME_FORMAT;
+
 //
 // Currently supported devices
 //
@@ -76,10 +152,77 @@ enum {
 #define MODE_FIFO  8
 #define MODE_3DPOS 16
 #define MODE_STEP  32
+#define MODE_STATUS 64 // read the status register along with the sample
+#define MODE_MAG 128
+
+// FIFO modes
+enum {
+   FIFO_MODE_STREAM=0, // oldest data is discarded when full
+   FIFO_MODE_FIFO, // collection stops when full
+   FIFO_MODE_TRIGGER // stream until a trigger event, then stop (ADXL345, LIS3DH/LIS3DSH)
+};
+
+// BNO055 operating modes (setBNOMode())
+enum {
+   BNO055_MODE_CONFIG=0,
+   BNO055_MODE_ACCONLY,
+   BNO055_MODE_MAGONLY,
+   BNO055_MODE_GYRONLY,
+   BNO055_MODE_ACCMAG,
+   BNO055_MODE_ACCGYRO,
+   BNO055_MODE_MAGGYRO,
+   BNO055_MODE_AMG,
+   BNO055_MODE_IMU, // fusion modes from here on
+   BNO055_MODE_COMPASS,
+   BNO055_MODE_M4G,
+   BNO055_MODE_NDOF_FMC_OFF,
+   BNO055_MODE_NDOF
+};
+#define IMU_BNO055_PROFILE_LEN 22
+
+// Orientation of the device during calibrate()
+enum {
+   IMU_FACE_XUP=0,
+   IMU_FACE_XDOWN,
+   IMU_FACE_YUP,
+   IMU_FACE_YDOWN,
+   IMU_FACE_ZUP, // lying flat
+   IMU_FACE_ZDOWN
+};
+#define IMU_CALIB_SAMPLES 128
+#define IMU_CALIB_LEN IMU_BNO055_PROFILE_LEN
+
+// Contents of the chip's offset registers (calibrate(), get/setCalibration())
+typedef struct _tagcalib
+{
+   uint8_t u8Type; // IMU_TYPE_xxx the data belongs to
+   uint8_t u8Len; // bytes used in u8Data
+   uint8_t u8Data[IMU_CALIB_LEN];
+} IMU_CALIB;
+
+// Interrupt sources for configIRQ()
+#define IMU_IRQ_DATA_READY 1
+#define IMU_IRQ_FIFO_WATERMARK 2
+#define IMU_IRQ_FIFO_FULL 4
 
 #define IMU_SUCCESS 0
 #define IMU_ERROR -1
 
+// Largest single I2C read transaction; the Arduino Wire library
+// has a 32-byte receive buffer on most targets (128 on ESP32)
+#ifndef IMU_MAX_I2C_READ
+#define IMU_MAX_I2C_READ 32
+#endif
+// Largest single I2C write transaction (including the register address)
+#ifndef IMU_MAX_I2C_WRITE
+#define IMU_MAX_I2C_WRITE 32
+#endif
+// Longest wait (ms) for the first data-ready at the end of start()
+// on top of 2 sample periods; covers the gyroscope startup times
+#ifndef IMU_START_TIMEOUT
+#define IMU_START_TIMEOUT 100
+#endif
+
 #define IMU_LSM9DS1_ADDR 0x6a
 #define IMU_ADXL345_ADDR 0x53
 #define IMU_BMI160_ADDR 0x68
@@ -106,16 +249,41 @@ enum {
 class BBIMU
 {
 public:
-    BBIMU() {_iType = IMU_TYPE_UNDEFINED; _iAccRate = _iGyroRate = 200; }
+    BBIMU() {_iType = IMU_TYPE_UNDEFINED; _u32Speed = 400000; _ucBNOMode = BNO055_MODE_CONFIG; _iAccScale = ACCEL_SCALE_2G; _iGyroScale = 0; _fAccScale = _fGyroScale = 0.0f; _iAccRate = _iGyroRate = 200; _iFIFOMode = FIFO_MODE_STREAM; _bFIFO = false; _iWatermark = 0; _pRing = NULL; _u32IRQCount = _u32IRQServiced = 0; _iPlanCount = 0; _u32LastStamp = 0; _iMagAddr = 0; _ucFaces = 0; _iClockPPM = 0; _bClockRef = _bClockValid = false; resetStats(); }
     ~BBIMU() {}
 
-    int init(int iSDA = -1, int iSCL = -1, bool bBitBang = false, uint32_t u32Speed=400000);
+    int init(int iSDA = -1, int iSCL = -1, bool bBitBang = false, uint32_t u32Speed=400000, int iType = IMU_TYPE_UNDEFINED, int iAddr = -1);
+    int scan(IMU_DEVICE *pList, int iMaxDevices, int iSDA = -1, int iSCL = -1, bool bBitBang = false, uint32_t u32Speed=400000);
     int start(int iSampleRate = 200, int iMode = MODE_ACCEL | MODE_GYRO);
     int stop(void);
     int reset(void);
-    int configFIFO(void);
-    int configIRQ(bool bOn);
+    int configFIFO(int iWatermark = 0);
+    int configIRQ(bool bOn, int iSources = IMU_IRQ_DATA_READY, int iPin = 1);
+    int getFIFOCount(void);
+    // Call from the data-ready pin ISR; the bus is only touched by serviceIRQ()
+    void dataReady(void) { _u32IRQCount = _u32IRQCount + 1; }
+    void setRing(IMU_SAMPLE *pRing, int iSize);
+    int serviceIRQ(void);
+    int popSamples(IMU_SAMPLE *pSamples, int iMaxSamples);
     int getQueuedSamples(int16_t *pSamples, int *iNumSamples, int iMaxSamples);
+    int getSamples(IMU_SAMPLE *pSamples, int iMaxSamples);
+    int getClockPPM(void);
+    int getMeasuredRate(void);
+    void getFIFOInfo(IMU_FIFO_INFO *pInfo);
+    void getStartupInfo(IMU_STARTUP_INFO *pInfo);
+    int getFrameFormat(IMU_FRAME_FORMAT *pFmt, bool bQueued);
+    static void decodeFrames(const IMU_FRAME_FORMAT *pFmt, const uint8_t *pData, int iFrames, int16_t *pAcc, int16_t *pGyro);
+    static void convertFrames(const IMU_FRAME_FORMAT *pFmt, const uint8_t *pData, int iFrames, float *pAcc, float *pGyro);
+    static int parseBMIFIFO(int iType, int iMode, const uint8_t *pFIFO, int iLen, int16_t *pSamples, int iMaxSamples, IMU_FIFO_INFO *pInfo, int *piUsed);
+    void setFIFOMode(int iMode);
+    int setBNOMode(int iOpMode);
+    int getFusion(IMU_FUSION *pFusion);
+    int getCalibStatus(void);
+    int getCalibProfile(uint8_t *pProfile);
+    int setCalibProfile(const uint8_t *pProfile);
+    int calibrate(IMU_CALIB *pCalib, int iFace = IMU_FACE_ZUP, int iSamples = IMU_CALIB_SAMPLES);
+    int getCalibration(IMU_CALIB *pCalib);
+    int setCalibration(const IMU_CALIB *pCalib);
     void setAccScale(int iScale);
     void setGyroScale(int iScale);
     void setAccRate(int iRate);
@@ -130,20 +298,82 @@ public:
     int type(void);
     BBI2C *getBB(void);
     int getSample(IMU_SAMPLE *pSample);
+    uint32_t getBusTime(int iSamples, uint32_t u32Channel = 0);
+    bool usesFIFO(void);
+    int getStats(IMU_STATS *pStats);
+    void resetStats(void);
  
 private:
     BBI2C _bbi2c;
+    uint32_t _u32Speed; // I2C clock
     int _iAddr;
     int _iType;
     int _iMode;
     int _iStatus, _iMagStart, _iAccStart, _iGyroStart, _iTempStart; // starting registers
+    uint8_t _ucAccReady, _ucGyroReady; // new data bits in the status register
+    // getSample() read plan (see planReads())
+    uint8_t _ucPlanReg[8], _ucPlanLen[8];
+    int _iPlanCount;
+    int _iAccOff, _iGyroOff, _iTempOff, _iStepOff, _iStatusOff, _iTimeOff, _iMagOff; // offsets in the read data
+    int _iTimeStart; // sensortime register
+    int _iQuatStart, _iQuatLen, _iQuatOff; // MODE_3DPOS outputs
+    int _iMagAddr; // I2C address of a separate magnetometer die (LSM9DS1), 0 = none
+    uint32_t _u32MagPeriod, _u32MagTime; // output period and time of the last read of that die
+    int16_t _i16Mag[3]; // last values read from it
     int _iAccRate, _iGyroRate; // sample rates
     int _iAccScale, _iGyroScale; // gravity scale
+    float _fAccScale, _fGyroScale; // g/LSB and dps/LSB (see setAccSensitivity())
     int _iStepStart;
     int _iTempLen; // length of temp info in bytes
     bool _bBigEndian;
     uint32_t _u32Caps;
+    IMU_FIFO_INFO _fifoInfo;
+    IMU_STARTUP_INFO _startupInfo;
+    int _iFIFOMode;
+    bool _bFIFO; // FIFO was enabled by configFIFO()
+    int _iWatermark; // FIFO threshold (samples) given to configFIFO()
+    uint8_t _ucFIFOCtrl; // QMI8658 FIFO_CTRL value
+    uint8_t _ucBNOMode; // BNO055 operating mode
+    int32_t _i32Face[6]; // 6-position accel capture (calibrate()), offsets removed
+    uint8_t _ucFaces; // faces captured so far
+    // single producer (serviceIRQ) / single consumer (popSamples) sample ring
+    IMU_SAMPLE *_pRing;
+    uint32_t _u32RingMask;
+    volatile uint32_t _u32RingHead, _u32RingTail;
+    volatile uint32_t _u32IRQCount; // incremented by dataReady()
+    uint32_t _u32IRQServiced;
+    uint32_t _u32LastStamp; // timestamp of the newest sample returned
+    // chip clock tracking (see trackClock())
+    bool _bClockRef, _bClockValid; // a window is open / a full window was measured
+    uint32_t _u32HostRef, _u32ChipRef; // start of the window
+    uint32_t _u32ChipUnits; // unwrapped sensortime ticks or samples counted
+    uint32_t _u32SensorTime; // last 24-bit sensortime
+    uint32_t _u32FIFOTime; // last sensortime frame used by fifoTime()
+    int _iClockPPM, _iPrevPPM;
+    int _iLostRef;
+#ifdef BB_IMU_STATS
+    IMU_STATS _stats;
+    uint32_t _u32StatsHash; // checksum of the last getSample() data
+    int statsI2C(int rc, int iBytes);
+#endif
     int16_t get16Bits(uint8_t *s);
+    int probe(int iType, int iAddr, IMU_DEVICE *pList, int iMax);
+    int readBurst(uint8_t ucReg, uint8_t *pData, int iLen, int iUnit);
     int matchRate(int value, int16_t *pList);
+    int qmiCommand(uint8_t ucCmd);
+    int waitReg(uint8_t ucReg, uint8_t ucMask, uint8_t ucValue, int iTimeout);
+    int bmi270Upload(void);
+    void planReads(void);
+    int channelReg(uint32_t u32Channel);
+    int unpackFIFO(IMU_SAMPLE *pSample, const int16_t *pData);
+    uint32_t fifoTime(int iCount, int iPending, uint32_t *pu32Period);
+    void trackClock(uint32_t u32Units, uint32_t u32Host, bool bTicks);
+    uint32_t sensorTime(uint32_t u32Sensor, uint32_t u32Now);
+    void setAccSensitivity(void);
+    int bnoMode(uint8_t ucMode);
+    int bnoProfile(uint8_t *pProfile, bool bSave);
+    int offsetRegs(uint8_t *pData, bool bSave);
+    void getOffsets(const uint8_t *pData, int *pAcc, int *pGyro);
+    void putOffsets(uint8_t *pData, const int *pAcc, const int *pGyro);
 }; // class BBIMU
 #endif // __BB_IMU__
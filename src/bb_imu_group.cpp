@@ -0,0 +1,133 @@
+// bb_imu_group.cpp
+// Multi-IMU read scheduling for bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "bb_imu_group.h"
+
+//
+// Add a started device to the group
+// iBus identifies the I2C bus it's on (devices sharing a bus share its time)
+// u32Budget limits the bus time (us) spent on it per service() call
+// Returns the device index (used in service() output) or IMU_ERROR
+//
+int BBIMUGroup::addDevice(BBIMU *pIMU, int iBus, uint32_t u32Budget)
+{
+IMU_GROUP_DEV *pDev;
+
+    if (pIMU == NULL || _iCount >= IMU_GROUP_MAX_DEVICES || iBus < 0 || iBus >= IMU_GROUP_MAX_BUSES) {
+        return IMU_ERROR;
+    }
+    pDev = &_devs[_iCount];
+    pDev->pIMU = pIMU;
+    pDev->u8Bus = (uint8_t)iBus;
+    pDev->u32Budget = u32Budget;
+    pDev->u32Next = micros();
+    _iCount++;
+    checkLoad();
+    return _iCount - 1;
+} /* addDevice() */
+
+//
+// Update the bus cost and sample period of every device (call again
+// after changing the rate or mode of one) and check that each bus can
+// carry the aggregate sample rate of its devices
+// Returns IMU_SUCCESS or IMU_ERROR if a bus is overloaded
+//
+int BBIMUGroup::checkLoad(void)
+{
+IMU_GROUP_DEV *pDev;
+int i, iRate, rc = IMU_SUCCESS;
+
+    for (i=0; i<_iCount; i++) {
+        pDev = &_devs[i];
+        pDev->u32Cost = pDev->pIMU->getBusTime(1);
+        iRate = pDev->pIMU->getMeasuredRate(); // mHz
+        pDev->u32Period = (iRate > 0) ? (uint32_t)(1000000000LL / iRate) : 0;
+    }
+    for (i=0; i<IMU_GROUP_MAX_BUSES; i++) {
+        if (getBusLoad(i) > IMU_GROUP_MAX_LOAD) rc = IMU_ERROR;
+    }
+    return rc;
+} /* checkLoad() */
+
+//
+// Return the share of bus iBus (per mille) taken by its devices at their
+// sample rates; over 1000 means the bus can't keep up at all
+//
+int BBIMUGroup::getBusLoad(int iBus)
+{
+uint64_t u64Time = 0; // us of bus time per second
+int i;
+
+    for (i=0; i<_iCount; i++) {
+        if (_devs[i].u8Bus == iBus && _devs[i].u32Period != 0) {
+            u64Time += (uint64_t)_devs[i].u32Cost * 1000000 / _devs[i].u32Period;
+        }
+    }
+    return (int)(u64Time / 1000);
+} /* getBusLoad() */
+
+//
+// Collect the samples which are ready on every device
+// pDevices (can be NULL) receives the device index of each sample.
+// The device visited first rotates on each call so that a full output
+// buffer doesn't always cut off the same devices.
+// Returns the number of samples stored
+//
+int BBIMUGroup::service(IMU_SAMPLE *pSamples, uint8_t *pDevices, int iMaxSamples)
+{
+IMU_GROUP_DEV *pDev;
+uint32_t u32Now;
+int i, j, k, iMax, iCount, iTotal = 0;
+
+    if (_iCount == 0) return 0;
+    for (k=0; k<_iCount && iTotal < iMaxSamples; k++) {
+        i = (_iFirst + k) % _iCount;
+        pDev = &_devs[i];
+        iMax = iMaxSamples - iTotal;
+        if (pDev->u32Budget != 0 && pDev->u32Cost != 0 && iMax > (int)(pDev->u32Budget / pDev->u32Cost)) {
+            iMax = (int)(pDev->u32Budget / pDev->u32Cost);
+            if (iMax == 0) iMax = 1; // always make progress
+        }
+        if (!pDev->pIMU->usesFIFO()) { // read the output registers once per sample period
+            u32Now = micros();
+            if ((int32_t)(u32Now - pDev->u32Next) < 0) continue; // not due yet
+            pDev->u32Next += pDev->u32Period;
+            if ((int32_t)(u32Now - pDev->u32Next) >= 0) pDev->u32Next = u32Now + pDev->u32Period; // fell behind
+            iMax = 1;
+        }
+        iCount = pDev->pIMU->getSamples(&pSamples[iTotal], iMax);
+        if (iCount <= 0) continue;
+        if (pDevices != NULL) {
+            for (j=0; j<iCount; j++) pDevices[iTotal + j] = (uint8_t)i;
+        }
+        iTotal += iCount;
+    }
+    _iFirst = (_iFirst + 1) % _iCount;
+    return iTotal;
+} /* service() */
+
+//
+// Return the number of devices in the group
+//
+int BBIMUGroup::count(void)
+{
+    return _iCount;
+} /* count() */
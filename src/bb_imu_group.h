@@ -0,0 +1,71 @@
+// bb_imu_group.h
+// Multi-IMU read scheduling for bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "bb_imu.h"
+
+#ifndef __BB_IMU_GROUP__
+#define __BB_IMU_GROUP__
+
+#define IMU_GROUP_MAX_DEVICES 8
+#define IMU_GROUP_MAX_BUSES 4
+// Share of each bus (per mille) which the devices may use before
+// checkLoad() reports an overload; the rest covers clock stretching,
+// gaps between transactions and other devices on the bus
+#ifndef IMU_GROUP_MAX_LOAD
+#define IMU_GROUP_MAX_LOAD 800
+#endif
+
+typedef struct _tagimugroupdev
+{
+   BBIMU *pIMU;
+   uint8_t u8Bus; // index of the I2C bus the device is on
+   uint32_t u32Budget; // bus time (us) allowed per service() call, 0 = no limit
+   uint32_t u32Cost; // bus time (us) of one sample
+   uint32_t u32Period; // sample period (us)
+   uint32_t u32Next; // when the next sample is due (polled devices)
+} IMU_GROUP_DEV;
+
+//
+// Reads several IMUs spread over one or more I2C buses
+// Each device is set up (init/start/configFIFO) on its own first, then
+// added to the group. service() visits them in turn: polled devices are
+// read when a new sample is due, FIFO devices are drained up to their
+// bus time budget so that one busy device can't starve the others.
+//
+class BBIMUGroup
+{
+public:
+    BBIMUGroup() {_iCount = 0; _iFirst = 0; }
+    ~BBIMUGroup() {}
+
+    int addDevice(BBIMU *pIMU, int iBus, uint32_t u32Budget = 0);
+    int checkLoad(void);
+    int getBusLoad(int iBus);
+    int service(IMU_SAMPLE *pSamples, uint8_t *pDevices, int iMaxSamples);
+    int count(void);
+
+private:
+    IMU_GROUP_DEV _devs[IMU_GROUP_MAX_DEVICES];
+    int _iCount;
+    int _iFirst; // device visited first by the next service()
+}; // class BBIMUGroup
+#endif // __BB_IMU_GROUP__
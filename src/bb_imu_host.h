@@ -0,0 +1,53 @@
+// bb_imu_host.h
+// Host (non-Arduino) build support for bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __BB_IMU_HOST__
+#define __BB_IMU_HOST__
+//
+// Lets bb_imu build outside of Arduino, e.g. on a Linux host for
+// regression tests or to measure the bus cost of each device and mode.
+// The program linking the library provides these functions: a
+// BitBang_I2C compatible bus (a simulated one answering with register
+// models of the IMUs, or a real one such as Linux i2c-dev) and the
+// Arduino timing functions. test/sim implements them with a simulated
+// bus which advances its clock by the time each transaction takes at the
+// I2C speed given to I2CInit(), so every timing in the library is
+// deterministic (see CMakeLists.txt for the host build and the tests).
+//
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef struct mybbi2c
+{
+   uint8_t iSDA, iSCL; // pins given to init(); can select one of several simulated buses
+   uint8_t bWire; // hardware I2C (true) or bit-banged
+} BBI2C;
+
+void I2CInit(BBI2C *pI2C, uint32_t iClock);
+uint8_t I2CTest(BBI2C *pI2C, uint8_t addr); // 1 if the address ACKs
+int I2CWrite(BBI2C *pI2C, uint8_t iAddr, uint8_t *pData, int iLen); // register + data
+int I2CReadRegister(BBI2C *pI2C, uint8_t iAddr, uint8_t u8Register, uint8_t *pData, int iLen);
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ulMs);
+void delayMicroseconds(unsigned int uiUs);
+#endif // __BB_IMU_HOST__
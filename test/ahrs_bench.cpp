@@ -0,0 +1,216 @@
+// ahrs_bench.cpp
+// Accuracy and speed of the BBAHRS filter on synthetic motion
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Built twice: ahrs_bench_fixed uses the Q8.24 filter and
+// ahrs_bench_float the same code with BB_AHRS_FLOAT defined.
+// 1) 60s of tumbling motion at 1kHz (+/-2000dps gyro, 2g accel, with
+//    noise); the tilt error is the angle between the true and estimated
+//    directions of gravity
+// 2) a static 60 degree yaw with the magnetometer, starting from 0
+// 3) the time per update()
+//
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include "bb_ahrs.h"
+
+#ifdef BB_AHRS_FLOAT
+#define AHRS_NAME "float"
+#else
+#define AHRS_NAME "Q8.24"
+#endif
+#define RATE 1000 // Hz
+#define SECONDS 60
+#define GYRO_LSB 16.4f // per dps at +/-2000dps
+#define ACC_LSB 16384.0f // per g at +/-2g
+#define DEG (180.0 / M_PI)
+
+static uint32_t u32Seed = 12345;
+
+//
+// Gaussian noise (sum of uniform values) with the given sigma
+//
+static double noise(double dSigma)
+{
+double d = 0.0;
+int i;
+
+    for (i=0; i<4; i++) {
+        u32Seed = u32Seed * 1664525 + 1013904223;
+        d += (double)(u32Seed >> 8) / 16777216.0 - 0.5;
+    }
+    return d * dSigma * 1.732; // 4 uniforms have a variance of 1/3
+} /* noise() */
+
+static int16_t toLSB(double d)
+{
+    d = floor(d + 0.5);
+    if (d > 32767.0) d = 32767.0;
+    else if (d < -32768.0) d = -32768.0;
+    return (int16_t)d;
+} /* toLSB() */
+
+//
+// Direction of gravity in the sensor axes for the orientation q
+// (the same convention as the filter)
+//
+static void gravity(const double *q, double *v)
+{
+    v[0] = 2.0 * (q[1]*q[3] - q[0]*q[2]);
+    v[1] = 2.0 * (q[0]*q[1] + q[2]*q[3]);
+    v[2] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+} /* gravity() */
+
+//
+// Rotate q by the body rates w (rad/s) over dt seconds
+//
+static void rotate(double *q, const double *w, double dt)
+{
+double r[4], n[4], dAngle, dNorm;
+int i;
+
+    dNorm = sqrt(w[0]*w[0] + w[1]*w[1] + w[2]*w[2]);
+    dAngle = dNorm * dt * 0.5;
+    r[0] = cos(dAngle);
+    for (i=0; i<3; i++) {
+        r[i+1] = (dNorm > 0.0) ? w[i] / dNorm * sin(dAngle) : 0.0;
+    }
+    n[0] = q[0]*r[0] - q[1]*r[1] - q[2]*r[2] - q[3]*r[3];
+    n[1] = q[0]*r[1] + q[1]*r[0] + q[2]*r[3] - q[3]*r[2];
+    n[2] = q[0]*r[2] - q[1]*r[3] + q[2]*r[0] + q[3]*r[1];
+    n[3] = q[0]*r[3] + q[1]*r[2] - q[2]*r[1] + q[3]*r[0];
+    memcpy(q, n, sizeof(n));
+} /* rotate() */
+
+//
+// Tumble for SECONDS and measure the tilt error of the filter
+//
+static void tumble(double *pMean, double *pMax)
+{
+BBAHRS ahrs;
+double q[4] = {1.0, 0.0, 0.0, 0.0}, qe[4], w[3], v[3], e[3], t, dErr, dSum;
+int32_t i32Q[4];
+int16_t acc[3], gyro[3];
+int i, j;
+
+    ahrs.setGyroScale(1.0f / GYRO_LSB);
+    dSum = *pMax = 0.0;
+    for (i=0; i<RATE * SECONDS; i++) {
+        t = (double)i / RATE;
+        w[0] = 200.0 * sin(2.0 * M_PI * 0.3 * t); // dps
+        w[1] = 150.0 * sin(2.0 * M_PI * 0.17 * t + 1.0);
+        w[2] = 100.0 * cos(2.0 * M_PI * 0.11 * t);
+        for (j=0; j<3; j++) {
+            gyro[j] = toLSB(w[j] * GYRO_LSB + noise(2.0));
+            w[j] /= DEG;
+        }
+        rotate(q, w, 1.0 / RATE);
+        gravity(q, v);
+        for (j=0; j<3; j++) {
+            acc[j] = toLSB(v[j] * ACC_LSB + noise(40.0));
+        }
+        ahrs.update(acc, gyro, NULL, 1000000 / RATE);
+        ahrs.getQuaternion(i32Q);
+        for (j=0; j<4; j++) {
+            qe[j] = (double)i32Q[j] / 1073741824.0;
+        }
+        gravity(qe, e);
+        dErr = (v[0]*e[0] + v[1]*e[1] + v[2]*e[2]) / sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+        dErr = acos((dErr > 1.0) ? 1.0 : dErr) * DEG;
+        dSum += dErr;
+        if (dErr > *pMax) *pMax = dErr;
+    }
+    *pMean = dSum / (RATE * SECONDS);
+} /* tumble() */
+
+//
+// Hold the sensor still at 60 degrees of yaw and return the heading
+// the filter settles on with the magnetometer
+//
+static double heading(void)
+{
+BBAHRS ahrs;
+double q[4], m[3], v[3];
+int16_t acc[3], gyro[3] = {0, 0, 0}, mag[3];
+int i, iEuler[3];
+
+    q[0] = cos(30.0 / DEG); q[1] = q[2] = 0.0; q[3] = sin(30.0 / DEG); // 60 degrees about Z
+    ahrs.setGyroScale(1.0f / GYRO_LSB);
+    gravity(q, v);
+    // earth field (north and down) in the sensor axes: R(q)^T * (20, 0, 40)uT
+    m[0] = 20.0 * (1.0 - 2.0*(q[2]*q[2] + q[3]*q[3])) + 40.0 * 2.0*(q[1]*q[3] - q[0]*q[2]);
+    m[1] = 20.0 * 2.0*(q[1]*q[2] - q[0]*q[3]) + 40.0 * 2.0*(q[2]*q[3] + q[0]*q[1]);
+    m[2] = 20.0 * 2.0*(q[1]*q[3] + q[0]*q[2]) + 40.0 * (1.0 - 2.0*(q[1]*q[1] + q[2]*q[2]));
+    for (i=0; i<3; i++) {
+        acc[i] = toLSB(v[i] * ACC_LSB);
+        mag[i] = toLSB(m[i] * 16.0);
+    }
+    // the heading correction is slow at the default gain (time constant ~20s)
+    for (i=0; i<100 * 300; i++) { // 300s at 100Hz
+        ahrs.update(acc, gyro, mag, 10000);
+    }
+    ahrs.getEuler(iEuler);
+    return iEuler[2] / 100.0;
+} /* heading() */
+
+//
+// Time per update() with the accelerometer and the magnetometer
+//
+static double speed(void)
+{
+BBAHRS ahrs;
+int16_t acc[3] = {1000, -2000, 15000}, gyro[3] = {300, -200, 100}, mag[3] = {320, 10, -640};
+int32_t i32Q[4];
+int i;
+
+    ahrs.setGyroScale(1.0f / GYRO_LSB);
+    auto start = std::chrono::steady_clock::now();
+    for (i=0; i<1000000; i++) {
+        gyro[0] = (int16_t)(i & 0x3ff); // keep the input changing
+        ahrs.update(acc, gyro, mag, 1000);
+    }
+    auto end = std::chrono::steady_clock::now();
+    ahrs.getQuaternion(i32Q);
+    if (i32Q[0] == 0x7fffffff) printf("\n"); // use the result
+    return std::chrono::duration<double, std::nano>(end - start).count() / 1000000.0;
+} /* speed() */
+
+int main(void)
+{
+double dMean, dMax, dYaw, dNs;
+int iFailures = 0;
+
+    tumble(&dMean, &dMax);
+    dYaw = heading();
+    dNs = speed();
+    printf("%s: tilt error mean %.3f deg, max %.3f deg; yaw %.2f deg (60 expected); %.1f ns/update\n",
+           AHRS_NAME, dMean, dMax, dYaw, dNs);
+    if (dMean > 0.5 || dMax > 3.0) {
+        printf("FAIL: tilt error\n");
+        iFailures++;
+    }
+    if (fabs(dYaw - 60.0) > 0.5) {
+        printf("FAIL: heading\n");
+        iFailures++;
+    }
+    return (iFailures) ? 1 : 0;
+} /* main() */
@@ -0,0 +1,159 @@
+// bus_bench.cpp
+// I2C bus cost of each IMU type, bus speed and read path
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Runs every supported type on the simulated bus at 100kHz, 400kHz and
+// 1MHz and reads it through getSample(), getOneChannel() and the FIFO
+// (getSamples() after configFIFO()). The bus counts the transactions,
+// the bytes on the wire (addresses, registers and data) and the time
+// they take, and the results are printed per sample as CSV along with
+// the bus time that getBusTime() predicts and the samples per second
+// that bus time allows. Redirect the output to a file to compare types,
+// modes and library versions.
+// The "FIFO drain" rows empty a full LSM6DS3 FIFO (accel + gyro at
+// 1660Hz) through getQueuedSamples() at 400kHz and 1MHz.
+//
+#include <stdio.h>
+#include "imu_sim.h"
+
+#define SAMPLE_RATE 200
+#define LOOPS 100 // getSample()/getOneChannel() calls
+#define FIFO_LOOPS 10 // FIFO reads
+#define FIFO_BATCH 32 // samples collected between FIFO reads
+#define DRAIN_RATE 1660
+#define DRAIN_SAMPLES 512 // fits in the LSM6DS3 FIFO (4096 words)
+
+static const char *szNames[] = {"", "ADXL345", "MPU6050", "LSM9DS1", "LSM6DS3", "BMI160",
+    "LIS3DH", "LIS3DSH", "MPU6886", "BNO055", "BMI270", "QMI8658", "MPU6500"};
+static const uint32_t u32Speeds[] = {100000, 400000, 1000000};
+// the step counter is only read on chips with IMU_CAP_PEDOMETER; the
+// others skip the last mode since it would repeat the one before
+static const int iModes[] = {MODE_ACCEL, MODE_ACCEL | MODE_GYRO, MODE_ACCEL | MODE_GYRO | MODE_TEMP,
+    MODE_ACCEL | MODE_GYRO | MODE_TEMP | MODE_STEP};
+static int iFailures;
+
+//
+// Print one line of results; returns false if nothing was measured
+//
+static bool report(int iType, uint32_t u32Speed, int iMode, const char *szPath, int iSamples, uint32_t u32Est)
+{
+SIM_BUS_STATS stats;
+
+    simGetStats(0, &stats);
+    if (iSamples <= 0 || stats.u32Transactions == 0) {
+        printf("FAIL %s %s at %d: %d samples\n", szNames[iType], szPath, (int)u32Speed, iSamples);
+        return false;
+    }
+    printf("%s,%d,%d,%s,%d,%.2f,%.1f,%.1f,%.1f,%.0f\n", szNames[iType], (int)u32Speed, iMode, szPath, iSamples,
+           (float)stats.u32Transactions / iSamples, (float)stats.u32Bytes / iSamples,
+           (float)stats.u64BusNs / 1000.0f / iSamples, (float)u32Est / iSamples,
+           (double)iSamples * 1e9 / (double)stats.u64BusNs);
+    return true;
+} /* report() */
+
+//
+// Measure the read paths of one type, speed and mode
+//
+static void bench(int iType, uint32_t u32Speed, int iMode)
+{
+BBIMU imu;
+IMU_SAMPLE samples[64];
+int i, iCount;
+
+    simReset();
+    simAddChip(0, iType);
+    if (imu.init(-1, -1, false, u32Speed, iType) != IMU_SUCCESS ||
+        imu.start(SAMPLE_RATE, iMode) != IMU_SUCCESS) {
+        printf("FAIL %s: init()/start()\n", szNames[iType]);
+        iFailures++;
+        return;
+    }
+    if ((iMode & MODE_STEP) && !(imu.caps() & IMU_CAP_PEDOMETER)) return;
+    simResetStats();
+    for (i=0; i<LOOPS; i++) {
+        simAdvance(1000000000ULL / SAMPLE_RATE);
+        imu.getSample(&samples[0]);
+    }
+    if (!report(iType, u32Speed, iMode, "getSample", LOOPS, imu.getBusTime(LOOPS))) iFailures++;
+
+    simResetStats();
+    for (i=0; i<LOOPS; i++) {
+        simAdvance(1000000000ULL / SAMPLE_RATE);
+        imu.getOneChannel(IMU_CHANNEL_ACC_X);
+    }
+    if (!report(iType, u32Speed, iMode, "getOneChannel", LOOPS, imu.getBusTime(LOOPS, IMU_CHANNEL_ACC_X))) iFailures++;
+
+    if (!imu.usesFIFO() && (imu.caps() & IMU_CAP_FIFO) && imu.configFIFO(FIFO_BATCH / 2) == IMU_SUCCESS && imu.usesFIFO()) {
+        simResetStats();
+        iCount = 0;
+        for (i=0; i<FIFO_LOOPS; i++) {
+            simAdvance((1000000000ULL / SAMPLE_RATE) * FIFO_BATCH);
+            iCount += imu.getSamples(samples, 64);
+        }
+        if (!report(iType, u32Speed, iMode, "FIFO", iCount, imu.getBusTime(iCount))) iFailures++;
+    }
+} /* bench() */
+
+//
+// Fill the LSM6DS3 FIFO, then empty it with getQueuedSamples() as fast
+// as the bus allows
+//
+static void drain(uint32_t u32Speed)
+{
+BBIMU imu;
+int16_t i16Data[64 * 6];
+int iCount, iTotal;
+
+    simReset();
+    simAddChip(0, IMU_TYPE_LSM6DS3);
+    if (imu.init(-1, -1, false, u32Speed, IMU_TYPE_LSM6DS3) != IMU_SUCCESS ||
+        imu.start(DRAIN_RATE, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS || imu.configFIFO(64) != IMU_SUCCESS) {
+        printf("FAIL LSM6DS3: FIFO drain setup\n");
+        iFailures++;
+        return;
+    }
+    simAdvance((1000000000ULL / DRAIN_RATE) * DRAIN_SAMPLES);
+    simResetStats();
+    iTotal = 0;
+    while (iTotal < DRAIN_SAMPLES) {
+        if (imu.getQueuedSamples(i16Data, &iCount, 64) != IMU_SUCCESS || iCount == 0) break;
+        iTotal += iCount;
+    }
+    if (!report(IMU_TYPE_LSM6DS3, u32Speed, MODE_ACCEL | MODE_GYRO, "FIFO drain", iTotal, imu.getBusTime(iTotal))) iFailures++;
+} /* drain() */
+
+int main(void)
+{
+int iType, s, m;
+
+    printf("type,speed,mode,path,samples,transactions_per_sample,bytes_per_sample,bus_us_per_sample,est_bus_us_per_sample,samples_per_s\n");
+    for (iType=IMU_TYPE_ADXL345; iType<TYPE_COUNT; iType++) {
+        for (s=0; s<(int)(sizeof(u32Speeds) / sizeof(u32Speeds[0])); s++) {
+            for (m=0; m<(int)(sizeof(iModes) / sizeof(iModes[0])); m++) {
+                bench(iType, u32Speeds[s], iModes[m]);
+            }
+        }
+    }
+    drain(400000);
+    drain(1000000);
+    simReset();
+    return (iFailures) ? 1 : 0;
+} /* main() */
@@ -0,0 +1,149 @@
+// decode_bench.cpp
+// Check and time the batch FIFO frame decoders on the host
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Built twice: decode_bench links the library with its SSE2/NEON kernels
+// and decode_bench_scalar a copy built with IMU_NO_SIMD. Both compare
+// decodeFrames()/convertFrames() with a one-value-at-a-time reference
+// for the frame layouts of the supported chips and every frame count up
+// to 40 (to cover the SIMD tails), then time them on 256 frames.
+//
+#include <stdio.h>
+#include <chrono>
+#include "bb_imu.h"
+
+#ifdef IMU_NO_SIMD
+#define DECODE_NAME "scalar"
+#else
+#define DECODE_NAME "simd"
+#endif
+#define FRAMES 256
+#define LOOPS 20000
+
+typedef struct _tagbenchfmt
+{
+   const char *szName;
+   uint8_t u8FrameLen, u8Acc, u8Gyro, bBigEndian;
+} BENCH_FMT;
+
+static const BENCH_FMT formats[] = {
+   {"MPU6050 acc+temp+gyro BE", 14, 0, 8, 1},
+   {"LSM6DS3 gyro+acc LE", 12, 6, 0, 0},
+   {"QMI8658 acc+gyro LE", 12, 0, 6, 0},
+   {"ADXL345 acc LE", 6, 0, 0xff, 0},
+};
+static uint8_t ucFIFO[FRAMES * 14];
+static int16_t i16Acc[FRAMES * 3], i16Gyro[FRAMES * 3], i16RefAcc[FRAMES * 3], i16RefGyro[FRAMES * 3];
+static float fAcc[FRAMES * 3], fGyro[FRAMES * 3];
+
+//
+// One value at a time, byte order checked per value, interleaved output
+// reordered into planes
+//
+static void reference(const IMU_FRAME_FORMAT *pFmt, const uint8_t *pData, int iFrames, int16_t *pAcc, int16_t *pGyro)
+{
+const uint8_t *s;
+int i, j;
+
+    for (i=0; i<iFrames; i++) {
+        for (j=0; j<3; j++) {
+            s = &pData[i * pFmt->u8FrameLen + pFmt->u8Acc + j*2];
+            pAcc[j * iFrames + i] = (pFmt->bBigEndian) ? (int16_t)((s[0] << 8) | s[1]) : (int16_t)(s[0] | (s[1] << 8));
+            if (pFmt->u8Gyro != 0xff) {
+                s = &pData[i * pFmt->u8FrameLen + pFmt->u8Gyro + j*2];
+                pGyro[j * iFrames + i] = (pFmt->bBigEndian) ? (int16_t)((s[0] << 8) | s[1]) : (int16_t)(s[0] | (s[1] << 8));
+            }
+        }
+    }
+} /* reference() */
+
+//
+// Compare the kernels with the reference for 1..40 frames
+// Returns the number of mismatches
+//
+static int check(const IMU_FRAME_FORMAT *pFmt)
+{
+int i, n, iErrors = 0;
+int iPlanes = (pFmt->u8Gyro != 0xff) ? 2 : 1;
+
+    for (n=1; n<=40; n++) {
+        // fill the values past the end so stray writes show up
+        for (i=0; i<FRAMES * 3; i++) {
+            i16Acc[i] = i16Gyro[i] = 0x5555;
+            fAcc[i] = fGyro[i] = -1e30f;
+        }
+        reference(pFmt, ucFIFO, n, i16RefAcc, i16RefGyro);
+        BBIMU::decodeFrames(pFmt, ucFIFO, n, i16Acc, (iPlanes == 2) ? i16Gyro : NULL);
+        BBIMU::convertFrames(pFmt, ucFIFO, n, fAcc, (iPlanes == 2) ? fGyro : NULL);
+        for (i=0; i<n * 3; i++) {
+            if (i16Acc[i] != i16RefAcc[i] || fAcc[i] != (float)i16RefAcc[i] * pFmt->fAccScale) iErrors++;
+            if (iPlanes == 2 && (i16Gyro[i] != i16RefGyro[i] || fGyro[i] != (float)i16RefGyro[i] * pFmt->fGyroScale)) iErrors++;
+        }
+        if (i16Acc[n * 3] != 0x5555 || fAcc[n * 3] != -1e30f || i16Gyro[n * 3] != 0x5555 || fGyro[n * 3] != -1e30f) iErrors++;
+    }
+    return iErrors;
+} /* check() */
+
+//
+// Average time per frame of iLoops calls in ns
+//
+template <typename T>
+static double timeIt(T fn)
+{
+int i;
+
+    auto start = std::chrono::steady_clock::now();
+    for (i=0; i<LOOPS; i++) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / ((double)LOOPS * FRAMES);
+} /* timeIt() */
+
+int main(void)
+{
+IMU_FRAME_FORMAT fmt;
+uint32_t u32Seed = 1;
+double dRef, dDecode, dConvert;
+int f, i, iErrors = 0;
+
+    for (i=0; i<(int)sizeof(ucFIFO); i++) {
+        u32Seed = u32Seed * 1664525 + 1013904223;
+        ucFIFO[i] = (uint8_t)(u32Seed >> 24);
+    }
+    printf("%s kernels, ns per frame (%d frames)\n", DECODE_NAME, FRAMES);
+    for (f=0; f<(int)(sizeof(formats) / sizeof(formats[0])); f++) {
+        fmt.u8FrameLen = formats[f].u8FrameLen;
+        fmt.u8Acc = formats[f].u8Acc;
+        fmt.u8Gyro = formats[f].u8Gyro;
+        fmt.bBigEndian = formats[f].bBigEndian;
+        fmt.fAccScale = 2.0f / 32768.0f;
+        fmt.fGyroScale = 1.0f / 131.0f;
+        i = check(&fmt);
+        iErrors += i;
+        dRef = timeIt([&]() { reference(&fmt, ucFIFO, FRAMES, i16RefAcc, i16RefGyro); });
+        dDecode = timeIt([&]() { BBIMU::decodeFrames(&fmt, ucFIFO, FRAMES, i16Acc, i16Gyro); });
+        dConvert = timeIt([&]() { BBIMU::convertFrames(&fmt, ucFIFO, FRAMES, fAcc, fGyro); });
+        printf("%-26s per value %6.2f  decodeFrames %6.2f (%.1fx)  convertFrames %6.2f  %s\n", formats[f].szName,
+               dRef, dDecode, dRef / dDecode, dConvert, (i) ? "MISMATCH" : "ok");
+    }
+    return (iErrors) ? 1 : 0;
+} /* main() */
@@ -0,0 +1,148 @@
+// ring_test.cpp
+// Exercise the interrupt sample ring with the producer on another thread
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// A thread stands in for the interrupt and the task calling serviceIRQ():
+// it lets simulated time pass, signals dataReady() and services it, while
+// the main thread drains the ring with popSamples() at an uneven pace.
+// The small ring overflows now and then, which must show up as lost
+// samples and never as torn, repeated or out of order ones.
+//
+#include <stdio.h>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include "imu_sim.h"
+
+#define RING_SIZE 32
+#define EVENTS 4000 // data-ready events (20s at 200Hz)
+#define FIFO_EVENTS 500 // watermark events (8 samples each)
+
+static BBIMU imu;
+static IMU_SAMPLE ring[RING_SIZE];
+static std::atomic<bool> bDone;
+static int iFailures;
+
+//
+// The accelerometer X and Y axes ramp up together with time, so every
+// sample is newer than the one before and both values of a sample match
+//
+static void simRamp(uint64_t u64Ns, SIM_MOTION *pMotion)
+{
+    memset(pMotion, 0, sizeof(SIM_MOTION));
+    pMotion->fAcc[0] = pMotion->fAcc[1] = -1.5f + (float)(u64Ns / 1000000ULL) * 0.0001f; // +1.6 LSB/ms at 2g
+    pMotion->fAcc[2] = 1.0f;
+    pMotion->fQuat[0] = 1.0f;
+} /* simRamp() */
+
+//
+// The "ISR": one data-ready event per period (a watermark's worth of
+// samples with the FIFO on), serviced right away or with the next one
+//
+static void producer(uint64_t u64Period, int iEvents)
+{
+int i;
+
+    for (i=0; i<iEvents; i++) {
+        simAdvance(u64Period);
+        imu.dataReady();
+        if (i % 7 != 3) { // sometimes 2 events arrive before it gets to run
+            imu.serviceIRQ();
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(20)); // the sample period, scaled down
+    }
+    bDone = true;
+} /* producer() */
+
+//
+// Start the chip, run the producer thread and check what comes out
+//
+static void runRing(int iType, bool bFIFO)
+{
+IMU_SAMPLE samples[5];
+IMU_FIFO_INFO info;
+int i, iCount, iTotal, iLoops, iEvents, iStart;
+int16_t i16Last;
+uint32_t u32Last;
+const char *szName = (bFIFO) ? "FIFO" : "data-ready";
+
+    simReset();
+    simSetMotion(simRamp);
+    simAddChip(0, iType);
+    if (imu.init() != IMU_SUCCESS || imu.start(200, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS) {
+        printf("FAIL %s: init()/start()\n", szName);
+        iFailures++;
+        return;
+    }
+    if (bFIFO) imu.configFIFO(8);
+    imu.setRing(ring, RING_SIZE);
+    bDone = false;
+    iEvents = (bFIFO) ? FIFO_EVENTS : EVENTS;
+    std::thread isr(producer, (bFIFO) ? 40000000ULL : 5000000ULL, iEvents); // 8 samples or 1 sample at 200Hz
+
+    iStart = iFailures;
+    iTotal = iLoops = 0;
+    i16Last = -32768;
+    u32Last = 0;
+    for (;;) {
+        bool bLast = bDone; // one more pass after the producer finished
+        iCount = imu.popSamples(samples, 1 + (iLoops % 5));
+        for (i=0; i<iCount; i++) {
+            if (samples[i].accel[0] != samples[i].accel[1]) {
+                printf("FAIL %s: torn sample (%d, %d)\n", szName, samples[i].accel[0], samples[i].accel[1]);
+                iFailures++;
+                break;
+            }
+            if (samples[i].accel[0] <= i16Last || (iTotal > 0 && (int32_t)(samples[i].timestamp - u32Last) <= 0)) {
+                printf("FAIL %s: sample %d out of order (%d after %d, %u after %u)\n", szName, iTotal, samples[i].accel[0], i16Last, samples[i].timestamp, u32Last);
+                iFailures++;
+                break;
+            }
+            i16Last = samples[i].accel[0];
+            u32Last = samples[i].timestamp;
+            iTotal++;
+        }
+        if (iFailures != iStart) break;
+        if (bLast && iCount == 0) break;
+        if (++iLoops % 3 == 0) std::this_thread::sleep_for(std::chrono::microseconds(iLoops % 50));
+    }
+    isr.join();
+    imu.getFIFOInfo(&info);
+    printf("%s: %d samples, %d lost\n", szName, iTotal, info.iLost);
+    if (!bFIFO && iTotal + info.iLost != EVENTS) { // one sample per event
+        printf("FAIL %s: %d samples + %d lost != %d events\n", szName, iTotal, info.iLost, EVENTS);
+        iFailures++;
+    }
+    if (iTotal == 0) {
+        printf("FAIL %s: no samples\n", szName);
+        iFailures++;
+    }
+    imu.setRing(NULL, 0);
+} /* runRing() */
+
+int main(void)
+{
+    runRing(IMU_TYPE_MPU6050, false);
+    runRing(IMU_TYPE_MPU6050, true);
+    simReset();
+    printf("%d failures\n", iFailures);
+    return (iFailures) ? 1 : 0;
+} /* main() */
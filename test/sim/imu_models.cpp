@@ -0,0 +1,1237 @@
+// imu_models.cpp
+// Register models of the IMUs supported by bb_imu for the simulated bus
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Each model covers what the library relies on: the ID register, the
+// reset/power-up handshakes (with their delays), the output data rate
+// decoded from the rate registers, the data-ready bits, the output
+// registers in the chip's byte order and sensitivity, and the FIFO with
+// its fill level, watermark, overflow and the way its data register
+// behaves on burst reads. Everything else reads back what was written.
+//
+#include "imu_sim.h"
+#include <math.h>
+#include <deque>
+#include <vector>
+
+#define SIM_MS 1000000ULL // ns in a millisecond
+#define SIM_G 9.80665f // m/s^2 in 1g
+#define SIM_TEMP 25.0f // degrees C reported by every chip
+
+//
+// Sample period in ns of an output data rate in Hz (0 = not sampling)
+//
+static uint64_t simPeriod(double dHz)
+{
+    return (dHz > 0.0) ? (uint64_t)(1e9 / dHz + 0.5) : 0;
+} /* simPeriod() */
+
+//
+// ST parts (LIS3DH, LSM9DS1 magnetometer) where the MSB of the
+// sub-address enables auto-increment on multi-byte transfers
+//
+class SimSTChip : public SimChip
+{
+public:
+    SimSTChip(uint8_t u8Addr) : SimChip(u8Addr) {}
+    int readRegs(uint8_t ucReg, uint8_t *pData, int iLen);
+    int writeRegs(uint8_t ucReg, const uint8_t *pData, int iLen);
+protected:
+    virtual bool autoInc(uint8_t ucReg) { return (ucReg & 0x80) != 0; }
+}; // class SimSTChip
+
+int SimSTChip::readRegs(uint8_t ucReg, uint8_t *pData, int iLen)
+{
+bool bInc;
+int i;
+
+    bInc = autoInc(ucReg);
+    ucReg &= 0x7f;
+    for (i=0; i<iLen; i++) {
+        pData[i] = readReg(ucReg);
+        if (bInc) ucReg = nextReg(ucReg);
+    }
+    return 1;
+} /* readRegs() */
+
+int SimSTChip::writeRegs(uint8_t ucReg, const uint8_t *pData, int iLen)
+{
+bool bInc;
+int i;
+
+    bInc = autoInc(ucReg);
+    ucReg &= 0x7f;
+    for (i=0; i<iLen; i++) {
+        writeReg(ucReg, pData[i]);
+        if (bInc) ucReg = nextReg(ucReg);
+    }
+    return 1;
+} /* writeRegs() */
+
+//
+// MPU6050 / MPU6500 / MPU6886
+// Asleep after power-on; big-endian outputs; the FIFO is a byte stream
+// of the enabled outputs read through FIFO_R_W, which doesn't increment
+//
+class SimMPU : public SimChip
+{
+public:
+    SimMPU(int iType, uint8_t u8Addr) : SimChip(u8Addr) { _iType = iType; _u64Reset = 0; _u64Delay[SIM_DELAY_RESET] = SIM_MS; powerOn(); }
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint8_t nextReg(uint8_t ucReg) { return (ucReg == 0x74) ? ucReg : ucReg + 1; }
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+    void tick(void);
+private:
+    void powerOn(void);
+    void push(uint8_t ucReg, int iLen);
+    int _iType;
+    uint64_t _u64Reset; // DEVICE_RESET completes at this time
+    std::deque<uint8_t> _fifo;
+}; // class SimMPU
+
+void SimMPU::powerOn(void)
+{
+    memset(_ucRegs, 0, sizeof(_ucRegs));
+    _ucRegs[0x6b] = 0x40; // PWR_MGMT_1: SLEEP
+    if (_iType == IMU_TYPE_MPU6050) _ucRegs[0x75] = 0x68; // WHO_AM_I
+    else if (_iType == IMU_TYPE_MPU6500) _ucRegs[0x75] = 0x70;
+    else _ucRegs[0x75] = 0x19;
+    _fifo.clear();
+} /* powerOn() */
+
+uint64_t SimMPU::period(void)
+{
+int iDLPF;
+
+    if (_ucRegs[0x6b] & 0xc0) return 0; // resetting or asleep
+    iDLPF = _ucRegs[0x1a] & 7; // CONFIG
+    // the divider runs from the 8kHz gyro rate with the DLPF off, 1kHz with it on
+    return simPeriod(((iDLPF == 0 || iDLPF == 7) ? 8000.0 : 1000.0) / (1 + _ucRegs[0x19])); // SMPLRT_DIV
+} /* period() */
+
+void SimMPU::tick(void)
+{
+    if (_u64Reset != 0 && _u64Now >= _u64Reset) {
+        _ucRegs[0x6b] &= ~0x80; // DEVICE_RESET self-clears
+        _u64Reset = 0;
+    }
+} /* tick() */
+
+uint8_t SimMPU::readReg(uint8_t ucReg)
+{
+uint8_t uc;
+
+    switch (ucReg) {
+        case 0x3a: // INT_STATUS, cleared by reading it
+            uc = _ucRegs[0x3a];
+            _ucRegs[0x3a] = 0;
+            return uc;
+        case 0x72: // FIFO_COUNTH
+            return (uint8_t)(_fifo.size() >> 8);
+        case 0x73: // FIFO_COUNTL
+            return (uint8_t)_fifo.size();
+        case 0x74: // FIFO_R_W
+            if (_fifo.empty()) return 0xff;
+            uc = _fifo.front();
+            _fifo.pop_front();
+            return uc;
+    }
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimMPU::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x6b && (ucVal & 0x80)) { // PWR_MGMT_1: DEVICE_RESET
+        powerOn();
+        _ucRegs[0x6b] |= 0x80;
+        _u64Reset = after(SIM_DELAY_RESET);
+    } else if (ucReg == 0x6a) { // USER_CTRL
+        if (ucVal & 0x04) _fifo.clear(); // FIFO_RST
+        _ucRegs[0x6a] = ucVal & ~0x04;
+    } else if (ucReg != 0x3a && ucReg < 0x72) { // the rest is read-only
+        _ucRegs[ucReg] = ucVal;
+    }
+} /* writeReg() */
+
+//
+// Queue the bytes of one output in the FIFO; the oldest bytes
+// are overwritten when it is full
+//
+void SimMPU::push(uint8_t ucReg, int iLen)
+{
+int i, iDepth;
+
+    iDepth = (_iType == IMU_TYPE_MPU6500) ? 512 : 1024;
+    for (i=0; i<iLen; i++) {
+        _fifo.push_back(_ucRegs[ucReg + i]);
+    }
+    while ((int)_fifo.size() > iDepth) {
+        _fifo.pop_front();
+        _ucRegs[0x3a] |= 0x10; // FIFO_OFLOW_INT
+    }
+} /* push() */
+
+void SimMPU::sample(const SIM_MOTION *pMotion)
+{
+float fAcc, fGyro, fTemp;
+uint8_t ucEnable;
+int i;
+
+    fAcc = (float)(16384 >> ((_ucRegs[0x1c] >> 3) & 3)); // ACCEL_CONFIG: LSB/g
+    fGyro = 131.0f / (float)(1 << ((_ucRegs[0x1b] >> 3) & 3)); // GYRO_CONFIG: LSB/dps
+    for (i=0; i<3; i++) {
+        put16(0x3b + i*2, lsb(pMotion->fAcc[i], fAcc), true); // ACCEL_XOUT_H
+        put16(0x43 + i*2, lsb(pMotion->fGyro[i], fGyro), true); // GYRO_XOUT_H
+    }
+    if (_iType == IMU_TYPE_MPU6050) fTemp = (SIM_TEMP - 36.53f) * 340.0f;
+    else if (_iType == IMU_TYPE_MPU6500) fTemp = (SIM_TEMP - 21.0f) * 333.87f;
+    else fTemp = (SIM_TEMP - 25.0f) * 326.8f;
+    put16(0x41, (int16_t)fTemp, true); // TEMP_OUT_H
+    _ucRegs[0x3a] |= 0x01; // DATA_RDY_INT
+    if (_ucRegs[0x6a] & 0x40) { // USER_CTRL: FIFO_EN
+        ucEnable = _ucRegs[0x23]; // FIFO_EN
+        if (ucEnable & 0x08) push(0x3b, 6); // ACCEL_FIFO_EN
+        if (_iType == IMU_TYPE_MPU6886) {
+            if (ucEnable & 0x10) push(0x41, 8); // GYRO_FIFO_EN (with the temperature)
+        } else {
+            if (ucEnable & 0x80) push(0x41, 2); // TEMP_FIFO_EN
+            for (i=0; i<3; i++) {
+                if (ucEnable & (0x40 >> i)) push(0x43 + i*2, 2); // XG/YG/ZG_FIFO_EN
+            }
+        }
+    }
+} /* sample() */
+
+//
+// ADXL345
+// Little-endian outputs; each FIFO entry is presented in DATAX0..DATAZ1
+// and popped when DATAZ1 is read
+//
+class SimADXL345 : public SimChip
+{
+public:
+    SimADXL345(uint8_t u8Addr);
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+private:
+    std::deque<uint8_t> _fifo;
+}; // class SimADXL345
+
+SimADXL345::SimADXL345(uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _ucRegs[0x00] = 0xe5; // DEVID
+    _ucRegs[0x2c] = 0x0a; // BW_RATE: 100Hz
+    _ucRegs[0x30] = 0x02; // INT_SOURCE
+} /* SimADXL345() */
+
+uint64_t SimADXL345::period(void)
+{
+    if (!(_ucRegs[0x2d] & 0x08)) return 0; // POWER_CTL: Measure
+    return 312500ULL << (15 - (_ucRegs[0x2c] & 0x0f)); // BW_RATE: 3200Hz / 2^(15-code)
+} /* period() */
+
+uint8_t SimADXL345::readReg(uint8_t ucReg)
+{
+uint8_t uc;
+
+    if (ucReg >= 0x32 && ucReg <= 0x37) { // DATAX0..DATAZ1
+        if ((_ucRegs[0x38] & 0xc0) && !_fifo.empty()) { // oldest FIFO entry
+            uc = _fifo[ucReg - 0x32];
+            if (ucReg == 0x37) {
+                _fifo.erase(_fifo.begin(), _fifo.begin() + 6);
+                if (_fifo.empty()) _ucRegs[0x30] &= ~0x80;
+            }
+            return uc;
+        }
+        _ucRegs[0x30] &= ~0x80; // DATA_READY
+        return _ucRegs[ucReg];
+    }
+    if (ucReg == 0x39) { // FIFO_STATUS: entries
+        return (uint8_t)(_fifo.size() / 6);
+    }
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimADXL345::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x38 && (ucVal & 0xc0) == 0) { // FIFO_CTL: bypass clears the FIFO
+        _fifo.clear();
+    }
+    if (ucReg != 0x00 && ucReg != 0x30 && ucReg != 0x39 && (ucReg < 0x32 || ucReg > 0x37)) {
+        _ucRegs[ucReg] = ucVal;
+    }
+} /* writeReg() */
+
+void SimADXL345::sample(const SIM_MOTION *pMotion)
+{
+float fAcc;
+int i, iMode;
+
+    // full resolution keeps 256 LSB/g, otherwise 10 bits over the range
+    fAcc = (_ucRegs[0x31] & 0x08) ? 256.0f : (float)(256 >> (_ucRegs[0x31] & 3)); // DATA_FORMAT
+    for (i=0; i<3; i++) {
+        put16(0x32 + i*2, lsb(pMotion->fAcc[i], fAcc), false);
+    }
+    _ucRegs[0x30] |= 0x80; // DATA_READY
+    iMode = _ucRegs[0x38] >> 6; // FIFO_CTL: bypass, FIFO, stream, trigger
+    if (iMode == 0) return;
+    if (_fifo.size() >= 32 * 6) {
+        _ucRegs[0x30] |= 0x01; // Overrun
+        if (iMode == 1) return; // FIFO mode stops collecting
+        _fifo.erase(_fifo.begin(), _fifo.begin() + 6);
+    }
+    for (i=0; i<6; i++) {
+        _fifo.push_back(_ucRegs[0x32 + i]);
+    }
+    if ((int)(_fifo.size() / 6) >= (_ucRegs[0x38] & 0x1f)) _ucRegs[0x30] |= 0x02; // Watermark
+} /* sample() */
+
+//
+// LIS3DH / LIS3DSH
+// Little-endian, left-justified outputs; with the FIFO enabled the data
+// registers show the oldest entry, reading OUT_Z_H pops it and the
+// address wraps from OUT_Z_H back to OUT_X_L
+//
+class SimLIS3D : public SimSTChip
+{
+public:
+    SimLIS3D(bool bDSH, uint8_t u8Addr);
+protected:
+    bool autoInc(uint8_t ucReg) { return (_bDSH) ? (_ucRegs[0x25] & 0x10) != 0 : (ucReg & 0x80) != 0; }
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint8_t nextReg(uint8_t ucReg) { return (ucReg == 0x2d && fifoMode() != 0) ? 0x28 : ucReg + 1; }
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+private:
+    int fifoMode(void);
+    bool _bDSH; // LIS3DSH
+    std::deque<uint8_t> _fifo;
+}; // class SimLIS3D
+
+SimLIS3D::SimLIS3D(bool bDSH, uint8_t u8Addr) : SimSTChip(u8Addr)
+{
+    _bDSH = bDSH;
+    _ucRegs[0x0f] = (bDSH) ? 0x3f : 0x33; // WHO_AM_I
+    _ucRegs[0x20] = 0x07; // CTRL_REG1 / CTRL_REG4: power down, X/Y/Z enabled
+    if (bDSH) _ucRegs[0x25] = 0x10; // CTRL_REG6: ADD_INC
+} /* SimLIS3D() */
+
+//
+// FIFO mode when the FIFO is enabled: 0 = bypass, 1 = FIFO, others stream
+//
+int SimLIS3D::fifoMode(void)
+{
+    if (_bDSH) {
+        return (_ucRegs[0x25] & 0x40) ? (_ucRegs[0x2e] >> 5) : 0; // CTRL_REG6 FIFO_EN, FIFO_CTRL FMODE
+    }
+    return (_ucRegs[0x24] & 0x40) ? (_ucRegs[0x2e] >> 6) : 0; // CTRL_REG5 FIFO_EN, FIFO_CTRL_REG FM
+} /* fifoMode() */
+
+uint64_t SimLIS3D::period(void)
+{
+static const double dLIS3DH[16] = {0, 1, 10, 25, 50, 100, 200, 400, 1620, 1344};
+static const double dLIS3DSH[16] = {0, 3.125, 6.25, 12.5, 25, 50, 100, 400, 800, 1600};
+
+    return simPeriod(((_bDSH) ? dLIS3DSH : dLIS3DH)[_ucRegs[0x20] >> 4]); // ODR
+} /* period() */
+
+uint8_t SimLIS3D::readReg(uint8_t ucReg)
+{
+uint8_t uc;
+int iCount;
+
+    if (ucReg >= 0x28 && ucReg <= 0x2d) { // OUT_X_L..OUT_Z_H
+        if (fifoMode() != 0 && !_fifo.empty()) { // oldest FIFO entry
+            uc = _fifo[ucReg - 0x28];
+            if (ucReg == 0x2d) _fifo.erase(_fifo.begin(), _fifo.begin() + 6);
+            return uc;
+        }
+        if (ucReg == 0x2d) _ucRegs[0x27] &= ~0x08; // STATUS: ZYXDA
+        return _ucRegs[ucReg];
+    }
+    if (ucReg == 0x2f) { // FIFO_SRC
+        iCount = (int)(_fifo.size() / 6);
+        uc = (uint8_t)(iCount & 0x1f); // FSS
+        if (iCount == 0) uc |= 0x20; // EMPTY
+        if (iCount == 32) uc |= 0x40; // OVRN: all levels full
+        if (iCount > (_ucRegs[0x2e] & 0x1f)) uc |= 0x80; // WTM
+        return uc;
+    }
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimLIS3D::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x0f || ucReg == 0x27 || (ucReg >= 0x28 && ucReg <= 0x2d) || ucReg == 0x2f) {
+        return; // read-only
+    }
+    _ucRegs[ucReg] = ucVal;
+    if (fifoMode() == 0) _fifo.clear(); // bypass (or disabled) empties the FIFO
+} /* writeReg() */
+
+void SimLIS3D::sample(const SIM_MOTION *pMotion)
+{
+static const float fLIS3DSH[8] = {16384.0f, 8192.0f, 5461.0f, 4096.0f, 1370.0f, 1370.0f, 1370.0f, 1370.0f}; // 2/4/6/8/16g
+float fAcc;
+int i, iFS;
+
+    if (_bDSH) {
+        fAcc = fLIS3DSH[(_ucRegs[0x24] >> 3) & 7]; // CTRL_REG5: FSCALE
+    } else {
+        iFS = (_ucRegs[0x23] >> 4) & 3; // CTRL_REG4: FS
+        fAcc = (iFS == 3) ? 1333.0f : (float)(16384 >> iFS);
+    }
+    for (i=0; i<3; i++) {
+        put16(0x28 + i*2, lsb(pMotion->fAcc[i], fAcc), false);
+    }
+    _ucRegs[0x0c] = 0; // temperature (relative reading)
+    _ucRegs[0x27] |= (_ucRegs[0x27] & 0x08) ? 0x80 : 0x08; // STATUS: ZYXDA, or ZYXOR if it was unread
+    if (fifoMode() == 0) return;
+    if (_fifo.size() >= 32 * 6) { // full
+        if (fifoMode() == 1) return; // FIFO mode stops collecting
+        _fifo.erase(_fifo.begin(), _fifo.begin() + 6);
+    }
+    for (i=0; i<6; i++) {
+        _fifo.push_back(_ucRegs[0x28 + i]);
+    }
+} /* sample() */
+
+//
+// LSM6DS3
+// Little-endian outputs; the FIFO holds 16-bit words (gyro X/Y/Z then
+// accel X/Y/Z per sample) and FIFO_DATA_OUT_H wraps back to _L.
+// Both sensors update at the accelerometer rate when it is on (start()
+// programs the same rate into both).
+//
+class SimLSM6DS3 : public SimChip
+{
+public:
+    SimLSM6DS3(uint8_t u8Addr);
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint8_t nextReg(uint8_t ucReg) { return (ucReg == 0x3f) ? 0x3e : ucReg + 1; }
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+private:
+    std::deque<uint8_t> _fifo;
+    bool _bOver; // FIFO_OVER
+}; // class SimLSM6DS3
+
+static const double lsm6ds3_odr[16] = {0, 12.5, 26, 52, 104, 208, 416, 833, 1666, 3333, 6666};
+
+SimLSM6DS3::SimLSM6DS3(uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _ucRegs[0x0f] = 0x69; // WHO_AM_I
+    _ucRegs[0x12] = 0x04; // CTRL3_C: IF_INC
+    _bOver = false;
+} /* SimLSM6DS3() */
+
+uint64_t SimLSM6DS3::period(void)
+{
+    if (_ucRegs[0x10] >> 4) return simPeriod(lsm6ds3_odr[_ucRegs[0x10] >> 4]); // CTRL1_XL
+    return simPeriod(lsm6ds3_odr[_ucRegs[0x11] >> 4]); // CTRL2_G
+} /* period() */
+
+uint8_t SimLSM6DS3::readReg(uint8_t ucReg)
+{
+uint8_t uc;
+int iWords;
+
+    iWords = (int)(_fifo.size() / 2);
+    switch (ucReg) {
+        case 0x3a: // FIFO_STATUS1
+            return (uint8_t)iWords;
+        case 0x3b: // FIFO_STATUS2
+            uc = (uint8_t)((iWords >> 8) & 0x0f);
+            if (iWords == 0) uc |= 0x10; // FIFO_EMPTY
+            if (_bOver) uc |= 0x40; // FIFO_OVER
+            if (iWords >= (_ucRegs[0x06] | ((_ucRegs[0x07] & 0x0f) << 8))) uc |= 0x80; // FTH
+            return uc;
+        case 0x3c: // FIFO_STATUS3/4: pattern (always starts at gyro X)
+        case 0x3d:
+            return 0;
+        case 0x3e: // FIFO_DATA_OUT_L/H
+        case 0x3f:
+            if (_fifo.empty()) return 0;
+            uc = _fifo.front();
+            _fifo.pop_front();
+            _bOver = false;
+            return uc;
+    }
+    if (ucReg >= 0x22 && ucReg <= 0x27) _ucRegs[0x1e] &= ~0x02; // STATUS_REG: GDA
+    else if (ucReg >= 0x28 && ucReg <= 0x2d) _ucRegs[0x1e] &= ~0x01; // XLDA
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimLSM6DS3::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x0f || (ucReg >= 0x1e && ucReg <= 0x2d) || (ucReg >= 0x3a && ucReg <= 0x3f)) {
+        return; // read-only
+    }
+    _ucRegs[ucReg] = ucVal;
+    if (ucReg == 0x0a && (ucVal & 7) == 0) { // FIFO_CTRL5: bypass empties the FIFO
+        _fifo.clear();
+        _bOver = false;
+    }
+} /* writeReg() */
+
+void SimLSM6DS3::sample(const SIM_MOTION *pMotion)
+{
+static const float fAccLSB[4] = {16384.0f, 2048.0f, 8192.0f, 4096.0f}; // 2/16/4/8g
+float fAcc, fGyro;
+int i, iLen, iMode;
+
+    fAcc = fAccLSB[(_ucRegs[0x10] >> 2) & 3]; // CTRL1_XL: FS_XL
+    fGyro = (_ucRegs[0x11] & 0x02) ? 228.57f : 114.29f / (float)(1 << ((_ucRegs[0x11] >> 2) & 3)); // CTRL2_G: FS_G
+    put16(0x20, (int16_t)((SIM_TEMP - 25.0f) * 16.0f), false); // OUT_TEMP_L
+    if (_ucRegs[0x11] >> 4) { // gyroscope on
+        for (i=0; i<3; i++) {
+            put16(0x22 + i*2, lsb(pMotion->fGyro[i], fGyro), false); // OUTX_L_G
+        }
+        _ucRegs[0x1e] |= 0x02; // GDA
+    }
+    if (_ucRegs[0x10] >> 4) { // accelerometer on
+        for (i=0; i<3; i++) {
+            put16(0x28 + i*2, lsb(pMotion->fAcc[i], fAcc), false); // OUTX_L_XL
+        }
+        _ucRegs[0x1e] |= 0x01; // XLDA
+    }
+    _ucRegs[0x1e] |= 0x04; // TDA
+    iMode = _ucRegs[0x0a] & 7; // FIFO_CTRL5: FIFO_MODE
+    if (iMode == 0 || (_ucRegs[0x0a] >> 3) == 0) return; // bypass or no FIFO ODR
+    iLen = ((_ucRegs[0x08] & 0x38) ? 6 : 0) + ((_ucRegs[0x08] & 0x07) ? 6 : 0); // FIFO_CTRL3: decimation
+    if (iLen == 0) return;
+    if ((int)_fifo.size() + iLen > 8192) { // 4096 words
+        if (iMode == 1) return; // FIFO mode stops collecting
+        _fifo.erase(_fifo.begin(), _fifo.begin() + iLen);
+        _bOver = true;
+    }
+    if (_ucRegs[0x08] & 0x38) { // gyro data set first
+        for (i=0; i<6; i++) _fifo.push_back(_ucRegs[0x22 + i]);
+    }
+    if (_ucRegs[0x08] & 0x07) {
+        for (i=0; i<6; i++) _fifo.push_back(_ucRegs[0x28 + i]);
+    }
+} /* sample() */
+
+//
+// LSM9DS1 accelerometer/gyroscope
+// When the gyroscope is on, the accelerometer runs at its rate
+//
+class SimLSM9DS1 : public SimChip
+{
+public:
+    SimLSM9DS1(uint8_t u8Addr);
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+}; // class SimLSM9DS1
+
+SimLSM9DS1::SimLSM9DS1(uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _ucRegs[0x0f] = 0x68; // WHO_AM_I
+    _ucRegs[0x22] = 0x04; // CTRL_REG8: IF_ADD_INC
+} /* SimLSM9DS1() */
+
+uint64_t SimLSM9DS1::period(void)
+{
+static const double dAcc[8] = {0, 10, 50, 119, 238, 476, 952, 0};
+static const double dGyro[8] = {0, 14.9, 59.5, 119, 238, 476, 952, 0};
+
+    if (_ucRegs[0x10] >> 5) return simPeriod(dGyro[_ucRegs[0x10] >> 5]); // CTRL_REG1_G
+    return simPeriod(dAcc[_ucRegs[0x20] >> 5]); // CTRL_REG6_XL
+} /* period() */
+
+uint8_t SimLSM9DS1::readReg(uint8_t ucReg)
+{
+    if (ucReg >= 0x18 && ucReg <= 0x1d) _ucRegs[0x17] &= ~0x02; // STATUS_REG: GDA
+    else if (ucReg >= 0x28 && ucReg <= 0x2d) _ucRegs[0x17] &= ~0x01; // XLDA
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimLSM9DS1::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg != 0x0f && !(ucReg >= 0x15 && ucReg <= 0x1d) && !(ucReg >= 0x27 && ucReg <= 0x2d)) {
+        _ucRegs[ucReg] = ucVal;
+    }
+} /* writeReg() */
+
+void SimLSM9DS1::sample(const SIM_MOTION *pMotion)
+{
+static const float fAccLSB[4] = {16384.0f, 2048.0f, 8192.0f, 4096.0f}; // 2/16/4/8g
+static const float fGyroLSB[4] = {114.29f, 57.14f, 114.29f, 14.29f}; // 245/500/-/2000dps
+float fAcc, fGyro;
+int i;
+
+    fAcc = fAccLSB[(_ucRegs[0x20] >> 3) & 3]; // CTRL_REG6_XL: FS_XL
+    fGyro = fGyroLSB[(_ucRegs[0x10] >> 3) & 3]; // CTRL_REG1_G: FS_G
+    put16(0x15, (int16_t)((SIM_TEMP - 25.0f) * 16.0f), false); // OUT_TEMP_L
+    if (_ucRegs[0x10] >> 5) { // gyroscope on
+        for (i=0; i<3; i++) {
+            put16(0x18 + i*2, lsb(pMotion->fGyro[i], fGyro), false); // OUT_X_L_G
+        }
+        _ucRegs[0x17] |= 0x02; // GDA
+    }
+    if ((_ucRegs[0x20] >> 5) || (_ucRegs[0x10] >> 5)) {
+        for (i=0; i<3; i++) {
+            put16(0x28 + i*2, lsb(pMotion->fAcc[i], fAcc), false); // OUT_X_L_XL
+        }
+        _ucRegs[0x17] |= 0x01; // XLDA
+    }
+} /* sample() */
+
+//
+// LSM9DS1 magnetometer (separate die)
+// Powered down until CTRL_REG3_M selects continuous conversion; its X axis
+// points the opposite way from the accelerometer/gyroscope X
+//
+class SimLSM9DS1Mag : public SimSTChip
+{
+public:
+    SimLSM9DS1Mag(uint8_t u8Addr);
+protected:
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+}; // class SimLSM9DS1Mag
+
+SimLSM9DS1Mag::SimLSM9DS1Mag(uint8_t u8Addr) : SimSTChip(u8Addr)
+{
+    _ucRegs[0x0f] = 0x3d; // WHO_AM_I_M
+    _ucRegs[0x20] = 0x10; // CTRL_REG1_M: 10Hz
+    _ucRegs[0x22] = 0x03; // CTRL_REG3_M: power down
+} /* SimLSM9DS1Mag() */
+
+uint64_t SimLSM9DS1Mag::period(void)
+{
+    if ((_ucRegs[0x22] & 3) != 0) return 0; // not in continuous conversion
+    return simPeriod(0.625 * (1 << ((_ucRegs[0x20] >> 2) & 7))); // DO: 0.625Hz << n
+} /* period() */
+
+void SimLSM9DS1Mag::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg != 0x0f && !(ucReg >= 0x27 && ucReg <= 0x2d)) {
+        _ucRegs[ucReg] = ucVal;
+    }
+} /* writeReg() */
+
+void SimLSM9DS1Mag::sample(const SIM_MOTION *pMotion)
+{
+static const float fMagLSB[4] = {71.43f, 34.48f, 23.26f, 17.24f}; // LSB/uT at 4/8/12/16 gauss
+float fMag;
+
+    fMag = fMagLSB[(_ucRegs[0x21] >> 5) & 3]; // CTRL_REG2_M: FS
+    put16(0x28, lsb(-pMotion->fMag[0], fMag), false); // OUT_X_L_M
+    put16(0x2a, lsb(pMotion->fMag[1], fMag), false);
+    put16(0x2c, lsb(pMotion->fMag[2], fMag), false);
+    _ucRegs[0x27] |= 0x08; // STATUS_REG_M: ZYXDA
+} /* sample() */
+
+//
+// BMI160 / BMI270
+// Little-endian outputs, a 24-bit sensortime (39.0625us ticks) from which
+// the output data rates are derived, and a FIFO of headered frames read
+// through FIFO_DATA (which doesn't increment). A frame cut off by the end
+// of a read is repeated by the next one. Reading past the stored frames
+// returns a sensortime frame (if enabled) and then 0x80 filler; frames
+// dropped on overflow are reported by a skip frame. Only the header mode
+// is modelled, which is the one the library uses.
+// BMI160: suspended until CMD powers up each sensor.
+// BMI270: does nothing until its config file is loaded.
+//
+class SimBMI : public SimChip
+{
+public:
+    SimBMI(bool b270, uint8_t u8Addr);
+    int readRegs(uint8_t ucReg, uint8_t *pData, int iLen);
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint8_t nextReg(uint8_t ucReg);
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+    void tick(void);
+private:
+    void powerOn(void);
+    bool accOn(void);
+    bool gyroOn(void);
+    uint64_t odr(uint8_t ucConf);
+    uint32_t sensorTime(void) { return (uint32_t)((_u64Now * 16) / 625000) & 0xffffff; }
+    uint8_t fifoByte(void);
+    void pushFrame(const uint8_t *pFrame, int iLen);
+    void flush(void) { _frames.clear(); _iFIFOBytes = _iSkipped = 0; }
+    bool _b270;
+    uint8_t _ucStatus, _ucAcc, _ucGyro, _ucTemp, _ucLen, _ucConfig1; // register layout
+    uint64_t _u64AccOn, _u64GyroOn; // BMI160: pending power-up of each sensor
+    uint64_t _u64Busy; // BMI270: soft reset in progress
+    uint64_t _u64InitDone; // BMI270: config file initialization completes
+    int _iUploaded; // BMI270: bytes written to INIT_DATA
+    std::deque<std::vector<uint8_t> > _frames;
+    int _iFIFOBytes, _iSkipped;
+    uint8_t _ucCur[16]; // frame being read by the current burst
+    int _iCurLen, _iCurOff, _iCurKind;
+    bool _bTimeRead; // sensortime frame returned by the current burst
+}; // class SimBMI
+
+SimBMI::SimBMI(bool b270, uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _b270 = b270;
+    _ucStatus = (b270) ? 0x03 : 0x1b;
+    _ucAcc = (b270) ? 0x0c : 0x12;
+    _ucGyro = (b270) ? 0x12 : 0x0c;
+    _ucTemp = (b270) ? 0x22 : 0x20;
+    _ucLen = (b270) ? 0x24 : 0x22; // FIFO_LENGTH_0, FIFO_DATA follows it
+    _ucConfig1 = (b270) ? 0x49 : 0x47;
+    _u64Busy = 0;
+    if (b270) _u64Delay[SIM_DELAY_RESET] = 20 * SIM_MS; // config file initialization
+    else _u64Delay[SIM_DELAY_POWERUP] = 55 * SIM_MS; // gyro to normal mode
+    powerOn();
+} /* SimBMI() */
+
+void SimBMI::powerOn(void)
+{
+    memset(_ucRegs, 0, sizeof(_ucRegs));
+    _ucRegs[0x00] = (_b270) ? 0x24 : 0xd1; // CHIP_ID
+    _ucRegs[0x40] = (_b270) ? 0xa8 : 0x28; // ACC_CONF: 100Hz
+    _ucRegs[0x41] = (_b270) ? 0x02 : 0x03; // ACC_RANGE: 8g / 2g
+    _ucRegs[0x42] = (_b270) ? 0xa9 : 0x28; // GYR_CONF: 200Hz / 100Hz
+    _ucRegs[_ucConfig1] = 0x10; // FIFO_CONFIG_1: header mode
+    if (_b270) {
+        _ucRegs[0x48] = 0x02; // FIFO_CONFIG_0: fifo_time_en
+        _ucRegs[0x7c] = 0x03; // PWR_CONF: adv_power_save
+    } else {
+        _ucRegs[0x46] = 0x80; // FIFO_CONFIG_0: watermark
+    }
+    _u64AccOn = _u64GyroOn = _u64InitDone = 0;
+    _iUploaded = 0;
+    _iCurOff = 0;
+    flush();
+} /* powerOn() */
+
+bool SimBMI::accOn(void)
+{
+    if (_b270) return _ucRegs[0x21] == 0x01 && (_ucRegs[0x7d] & 0x04); // init_ok, PWR_CTRL acc_en
+    return ((_ucRegs[0x03] >> 4) & 3) == 1; // PMU_STATUS: acc normal
+} /* accOn() */
+
+bool SimBMI::gyroOn(void)
+{
+    if (_b270) return _ucRegs[0x21] == 0x01 && (_ucRegs[0x7d] & 0x02); // init_ok, PWR_CTRL gyr_en
+    return ((_ucRegs[0x03] >> 2) & 3) == 1; // PMU_STATUS: gyr normal
+} /* gyroOn() */
+
+//
+// Sample period of an ODR code: 100Hz * 2^(code - 8); the periods are
+// whole multiples of each other, so every sensor stays on one time grid
+//
+uint64_t SimBMI::odr(uint8_t ucConf)
+{
+int iCode;
+
+    iCode = ucConf & 0x0f;
+    if (iCode == 0) iCode = 8;
+    return (iCode <= 8) ? (10000000ULL << (8 - iCode)) : (10000000ULL >> (iCode - 8));
+} /* odr() */
+
+uint64_t SimBMI::period(void)
+{
+uint64_t p = 0;
+
+    if (accOn()) p = odr(_ucRegs[0x40]);
+    if (gyroOn() && (p == 0 || odr(_ucRegs[0x42]) < p)) p = odr(_ucRegs[0x42]);
+    return p;
+} /* period() */
+
+void SimBMI::tick(void)
+{
+    if (_u64AccOn != 0 && _u64Now >= _u64AccOn) {
+        _ucRegs[0x03] = (_ucRegs[0x03] & ~0x30) | 0x10; // PMU_STATUS: acc normal
+        _u64AccOn = 0;
+    }
+    if (_u64GyroOn != 0 && _u64Now >= _u64GyroOn) {
+        _ucRegs[0x03] = (_ucRegs[0x03] & ~0x0c) | 0x04; // gyr normal
+        _u64GyroOn = 0;
+    }
+    if (_u64InitDone != 0 && _u64Now >= _u64InitDone) {
+        _ucRegs[0x21] = 0x01; // INTERNAL_STATUS: init_ok
+        _u64InitDone = 0;
+    }
+} /* tick() */
+
+//
+// Each burst starts reading the FIFO at the beginning of a frame
+//
+int SimBMI::readRegs(uint8_t ucReg, uint8_t *pData, int iLen)
+{
+    _iCurOff = 0;
+    _bTimeRead = false;
+    return SimChip::readRegs(ucReg, pData, iLen);
+} /* readRegs() */
+
+uint8_t SimBMI::nextReg(uint8_t ucReg)
+{
+    if (ucReg == _ucLen + 2 || (_b270 && ucReg == 0x5e)) return ucReg; // FIFO_DATA, INIT_DATA
+    return ucReg + 1;
+} /* nextReg() */
+
+//
+// Return the next byte of FIFO_DATA; a frame is only consumed
+// once its last byte has been read
+//
+uint8_t SimBMI::fifoByte(void)
+{
+uint32_t u32;
+uint8_t uc;
+
+    if (_iCurOff == 0) { // pick the frame to return
+        if (_iSkipped) {
+            _ucCur[0] = 0x40; // skip frame
+            _ucCur[1] = (uint8_t)((_iSkipped > 255) ? 255 : _iSkipped);
+            _iCurLen = 2; _iCurKind = 1;
+        } else if (!_frames.empty()) {
+            memcpy(_ucCur, &_frames.front()[0], _frames.front().size());
+            _iCurLen = (int)_frames.front().size(); _iCurKind = 2;
+        } else if ((_ucRegs[(_b270) ? 0x48 : 0x47] & 0x02) && !_bTimeRead) { // fifo_time_en
+            u32 = sensorTime();
+            _ucCur[0] = 0x44; // sensortime frame
+            _ucCur[1] = (uint8_t)u32; _ucCur[2] = (uint8_t)(u32 >> 8); _ucCur[3] = (uint8_t)(u32 >> 16);
+            _iCurLen = 4; _iCurKind = 3;
+        } else {
+            _ucCur[0] = 0x80; // over-read
+            _iCurLen = 1; _iCurKind = 0;
+        }
+    }
+    uc = _ucCur[_iCurOff++];
+    if (_iCurOff == _iCurLen) { // the whole frame was read
+        _iCurOff = 0;
+        if (_iCurKind == 1) {
+            _iSkipped -= _ucCur[1];
+        } else if (_iCurKind == 2) {
+            _iFIFOBytes -= _iCurLen;
+            _frames.pop_front();
+        } else if (_iCurKind == 3) {
+            _bTimeRead = true;
+        }
+    }
+    return uc;
+} /* fifoByte() */
+
+uint8_t SimBMI::readReg(uint8_t ucReg)
+{
+uint32_t u32;
+
+    if (ucReg == _ucLen) return (uint8_t)_iFIFOBytes; // FIFO_LENGTH_0
+    if (ucReg == _ucLen + 1) return (uint8_t)(_iFIFOBytes >> 8);
+    if (ucReg == _ucLen + 2) return fifoByte(); // FIFO_DATA
+    if (ucReg >= 0x18 && ucReg <= 0x1a) { // SENSORTIME_0..2
+        u32 = sensorTime();
+        return (uint8_t)(u32 >> ((ucReg - 0x18) * 8));
+    }
+    if (ucReg >= _ucAcc && ucReg < _ucAcc + 6) _ucRegs[_ucStatus] &= ~0x80; // STATUS: drdy_acc
+    else if (ucReg >= _ucGyro && ucReg < _ucGyro + 6) _ucRegs[_ucStatus] &= ~0x40; // drdy_gyr
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimBMI::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (_b270 && _u64Now < _u64Busy) return; // still in the soft reset
+    if (ucReg == 0x7e) { // CMD
+        if (ucVal == 0xb6) { // softreset
+            powerOn();
+            if (_b270) _u64Busy = _u64Now + 2 * SIM_MS;
+        } else if (ucVal == 0xb0) { // fifo_flush
+            flush();
+        } else if (!_b270 && (ucVal & 0xfc) == 0x10) { // acc_set_pmu_mode
+            if ((ucVal & 3) == 1) _u64AccOn = _u64Now + 4 * SIM_MS; // 3.8ms to normal mode
+            else _ucRegs[0x03] = (_ucRegs[0x03] & ~0x30) | ((ucVal & 3) << 4);
+        } else if (!_b270 && (ucVal & 0xfc) == 0x14) { // gyr_set_pmu_mode
+            if ((ucVal & 3) == 1) _u64GyroOn = after(SIM_DELAY_POWERUP);
+            else _ucRegs[0x03] &= ~0x0c;
+        }
+        return;
+    }
+    if (_b270 && ucReg == 0x59) { // INIT_CTRL
+        if (ucVal == 0) {
+            _iUploaded = 0;
+        } else if (ucVal == 1) {
+            if (_iUploaded >= 8192) _u64InitDone = after(SIM_DELAY_RESET);
+            else _ucRegs[0x21] = 0x02; // init_err
+        }
+        _ucRegs[ucReg] = ucVal;
+        return;
+    }
+    if (_b270 && ucReg == 0x5e) { // INIT_DATA (only with advanced power save off)
+        if (!(_ucRegs[0x7c] & 0x01)) _iUploaded++;
+        return;
+    }
+    if (ucReg == 0x00 || ucReg == _ucStatus || (ucReg >= 0x0c && ucReg <= 0x23) || (ucReg >= _ucLen && ucReg <= _ucLen + 2)) {
+        return; // read-only
+    }
+    _ucRegs[ucReg] = ucVal;
+} /* writeReg() */
+
+//
+// Queue a frame; when it doesn't fit, the BMI270 can stop collecting,
+// otherwise the oldest frames make room and are counted as skipped
+//
+void SimBMI::pushFrame(const uint8_t *pFrame, int iLen)
+{
+int iDepth;
+
+    iDepth = (_b270) ? 6144 : 1024;
+    while (_iFIFOBytes + iLen > iDepth) {
+        if (_b270 && (_ucRegs[0x48] & 0x01)) return; // fifo_stop_on_full
+        _iFIFOBytes -= (int)_frames.front().size();
+        _frames.pop_front();
+        _iSkipped++;
+        _iCurOff = 0;
+    }
+    _frames.push_back(std::vector<uint8_t>(pFrame, pFrame + iLen));
+    _iFIFOBytes += iLen;
+} /* pushFrame() */
+
+void SimBMI::sample(const SIM_MOTION *pMotion)
+{
+static const float fBMI160Acc[16] = {0, 0, 0, 16384.0f, 0, 8192.0f, 0, 0, 4096.0f, 0, 0, 0, 2048.0f}; // ACC_RANGE codes
+uint8_t ucFrame[13], ucConfig;
+float fAcc, fGyro;
+bool bAcc, bGyro;
+int i, iLen;
+
+    bAcc = accOn() && (_u64Now % odr(_ucRegs[0x40])) == 0;
+    bGyro = gyroOn() && (_u64Now % odr(_ucRegs[0x42])) == 0;
+    fAcc = (_b270) ? (float)(16384 >> (_ucRegs[0x41] & 3)) : fBMI160Acc[_ucRegs[0x41] & 0x0f];
+    fGyro = 16.4f * (float)(1 << (_ucRegs[0x43] & 7)); // GYR_RANGE: 2000dps >> n
+    if (bAcc) {
+        for (i=0; i<3; i++) {
+            put16(_ucAcc + i*2, lsb(pMotion->fAcc[i], fAcc), false);
+        }
+        _ucRegs[_ucStatus] |= 0x80; // drdy_acc
+    }
+    if (bGyro) {
+        for (i=0; i<3; i++) {
+            put16(_ucGyro + i*2, lsb(pMotion->fGyro[i], fGyro), false);
+        }
+        _ucRegs[_ucStatus] |= 0x40; // drdy_gyr
+    }
+    put16(_ucTemp, (int16_t)((SIM_TEMP - 23.0f) * 512.0f), false);
+    ucConfig = _ucRegs[_ucConfig1]; // FIFO_CONFIG_1
+    if (!(ucConfig & 0x10)) return; // headerless mode isn't modelled
+    ucFrame[0] = 0x80; // regular frame header
+    iLen = 1;
+    if (bGyro && (ucConfig & 0x80)) { // fifo_gyr_en, gyroscope first
+        ucFrame[0] |= 0x08;
+        memcpy(&ucFrame[iLen], &_ucRegs[_ucGyro], 6);
+        iLen += 6;
+    }
+    if (bAcc && (ucConfig & 0x40)) { // fifo_acc_en
+        ucFrame[0] |= 0x04;
+        memcpy(&ucFrame[iLen], &_ucRegs[_ucAcc], 6);
+        iLen += 6;
+    }
+    if (iLen > 1) pushFrame(ucFrame, iLen);
+} /* sample() */
+
+//
+// QMI8658
+// Little-endian outputs; address auto-increment only with CTRL1 ADDR_AI.
+// CTRL9 commands complete at once (STATUSINT CmdDone until acknowledged).
+// The FIFO holds accel then gyro per sample and is read through FIFO_DATA
+// after CTRL_CMD_REQ_FIFO. The AttitudeEngine outputs the rotation (dQ)
+// and velocity (dV, 1024 LSB = 1m/s) increments over each of its periods.
+// With the gyroscope on, the accelerometer runs at the gyroscope rate.
+//
+class SimQMI8658 : public SimChip
+{
+public:
+    SimQMI8658(uint8_t u8Addr);
+protected:
+    uint8_t readReg(uint8_t ucReg);
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint8_t nextReg(uint8_t ucReg);
+    uint64_t period(void);
+    void sample(const SIM_MOTION *pMotion);
+private:
+    std::deque<uint8_t> _fifo;
+    bool _bOver; // FIFO_OVFLOW
+}; // class SimQMI8658
+
+SimQMI8658::SimQMI8658(uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _ucRegs[0x00] = 0x05; // WHO_AM_I
+    _ucRegs[0x01] = 0x7c; // REVISION_ID
+    _ucRegs[0x02] = 0x20; // CTRL1: big-endian off, no auto-increment
+    _bOver = false;
+} /* SimQMI8658() */
+
+uint8_t SimQMI8658::nextReg(uint8_t ucReg)
+{
+    if (!(_ucRegs[0x02] & 0x40) || ucReg == 0x17) return ucReg; // CTRL1 ADDR_AI, FIFO_DATA
+    return ucReg + 1;
+} /* nextReg() */
+
+uint64_t SimQMI8658::period(void)
+{
+uint8_t ucEnable = _ucRegs[0x08]; // CTRL7
+
+    if (ucEnable & 0x08) return simPeriod((double)(1 << (_ucRegs[0x07] & 7))); // CTRL6 sODR: 2^n Hz
+    if (ucEnable & 0x02) return simPeriod(7520.0 / (1 << (_ucRegs[0x04] & 0x0f))); // CTRL3 gODR
+    if (ucEnable & 0x01) return simPeriod(8000.0 / (1 << (_ucRegs[0x03] & 0x0f))); // CTRL2 aODR
+    return 0;
+} /* period() */
+
+uint8_t SimQMI8658::readReg(uint8_t ucReg)
+{
+uint8_t uc;
+int iWords;
+
+    iWords = (int)(_fifo.size() / 2);
+    switch (ucReg) {
+        case 0x15: // FIFO_SMPL_CNT (2-byte words)
+            return (uint8_t)iWords;
+        case 0x16: // FIFO_STATUS
+            uc = (uint8_t)((iWords >> 8) & 3);
+            if (iWords) uc |= 0x10; // FIFO_NOT_EMPTY
+            if (_bOver) uc |= 0x20; // FIFO_OVFLOW
+            if (_ucRegs[0x13] && iWords >= _ucRegs[0x13] * 6) uc |= 0x40; // FIFO_WTM
+            return uc;
+        case 0x17: // FIFO_DATA
+            if (!(_ucRegs[0x14] & 0x80) || _fifo.empty()) return 0; // FIFO_RD_MODE
+            uc = _fifo.front();
+            _fifo.pop_front();
+            _bOver = false;
+            return uc;
+        case 0x2e: // STATUS0, cleared by reading it
+            uc = _ucRegs[0x2e];
+            _ucRegs[0x2e] = 0;
+            return uc;
+    }
+    return _ucRegs[ucReg];
+} /* readReg() */
+
+void SimQMI8658::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x0a) { // CTRL9
+        if (ucVal == 0x00) { // CTRL_CMD_ACK
+            _ucRegs[0x2d] &= ~0x80;
+        } else {
+            if (ucVal == 0x04) { // CTRL_CMD_RST_FIFO
+                _fifo.clear();
+                _bOver = false;
+            } else if (ucVal == 0x05) { // CTRL_CMD_REQ_FIFO
+                _ucRegs[0x14] |= 0x80; // FIFO_RD_MODE
+            }
+            _ucRegs[0x2d] |= 0x80; // STATUSINT: CmdDone
+        }
+        _ucRegs[0x0a] = ucVal;
+        return;
+    }
+    if (ucReg <= 0x01 || (ucReg >= 0x15 && ucReg <= 0x17) || ucReg >= 0x2d) {
+        return; // read-only
+    }
+    _ucRegs[ucReg] = ucVal;
+    if (ucReg == 0x14 && (ucVal & 3) == 0) _fifo.clear(); // FIFO_CTRL: bypass
+} /* writeReg() */
+
+void SimQMI8658::sample(const SIM_MOTION *pMotion)
+{
+float fAcc, fGyro, fDt, fAngle, fRate, fSin;
+uint8_t ucEnable;
+int i, iLen, iDepth;
+
+    ucEnable = _ucRegs[0x08]; // CTRL7
+    fAcc = (float)(16384 >> ((_ucRegs[0x03] >> 4) & 3)); // CTRL2 aFS
+    fGyro = (float)(2048 >> ((_ucRegs[0x04] >> 4) & 7)); // CTRL3 gFS
+    put16(0x33, (int16_t)(SIM_TEMP * 256.0f), false); // TEMP_L
+    if (ucEnable & 0x01) {
+        for (i=0; i<3; i++) put16(0x35 + i*2, lsb(pMotion->fAcc[i], fAcc), false); // AX_L
+        _ucRegs[0x2e] |= 0x01; // STATUS0: aDA
+    }
+    if (ucEnable & 0x02) {
+        for (i=0; i<3; i++) put16(0x3b + i*2, lsb(pMotion->fGyro[i], fGyro), false); // GX_L
+        _ucRegs[0x2e] |= 0x02; // gDA
+    }
+    if (ucEnable & 0x08) { // AttitudeEngine
+        fDt = (float)period() * 1e-9f;
+        fRate = sqrtf(pMotion->fGyro[0]*pMotion->fGyro[0] + pMotion->fGyro[1]*pMotion->fGyro[1] + pMotion->fGyro[2]*pMotion->fGyro[2]);
+        fAngle = fRate * fDt * (float)M_PI / 180.0f;
+        fSin = (fRate > 0.0f) ? sinf(fAngle * 0.5f) / fRate : 0.0f;
+        put16(0x49, lsb(cosf(fAngle * 0.5f), 16384.0f), false); // dQW_L
+        for (i=0; i<3; i++) {
+            put16(0x4b + i*2, lsb(pMotion->fGyro[i] * fSin, 16384.0f), false); // dQX_L
+            put16(0x51 + i*2, lsb(pMotion->fAcc[i] * SIM_G * fDt, 1024.0f), false); // dVX_L
+        }
+        _ucRegs[0x2e] |= 0x08; // sDA
+    }
+    if ((_ucRegs[0x14] & 3) == 0 || (_ucRegs[0x14] & 0x80)) return; // bypass or being read
+    iLen = ((ucEnable & 0x01) ? 6 : 0) + ((ucEnable & 0x02) ? 6 : 0);
+    if (iLen == 0) return;
+    iDepth = (16 << ((_ucRegs[0x14] >> 2) & 3)) * iLen; // FIFO_SIZE in samples
+    if ((int)_fifo.size() + iLen > iDepth) {
+        _bOver = true;
+        if ((_ucRegs[0x14] & 3) == 1) return; // FIFO mode stops collecting
+        _fifo.erase(_fifo.begin(), _fifo.begin() + iLen);
+    }
+    if (ucEnable & 0x01) {
+        for (i=0; i<6; i++) _fifo.push_back(_ucRegs[0x35 + i]);
+    }
+    if (ucEnable & 0x02) {
+        for (i=0; i<6; i++) _fifo.push_back(_ucRegs[0x3b + i]);
+    }
+} /* sample() */
+
+//
+// BNO055
+// Starts in CONFIG mode; OPR_MODE switches take 7ms (19ms back to CONFIG)
+// and are reported by SYS_STATUS. The outputs of the sensors used by the
+// operating mode update at 100Hz, plus the fusion outputs in fusion modes.
+//
+class SimBNO055 : public SimChip
+{
+public:
+    SimBNO055(uint8_t u8Addr);
+protected:
+    void writeReg(uint8_t ucReg, uint8_t ucVal);
+    uint64_t period(void) { return (_ucMode != BNO055_MODE_CONFIG) ? 10 * SIM_MS : 0; }
+    void sample(const SIM_MOTION *pMotion);
+    void tick(void);
+private:
+    uint8_t _ucMode, _ucNextMode;
+    uint64_t _u64Switch; // the mode switch completes at this time
+}; // class SimBNO055
+
+SimBNO055::SimBNO055(uint8_t u8Addr) : SimChip(u8Addr)
+{
+    _ucRegs[0x00] = 0xa0; // CHIP_ID
+    _ucRegs[0x01] = 0xfb; // ACC_ID
+    _ucRegs[0x02] = 0x32; // MAG_ID
+    _ucRegs[0x03] = 0x0f; // GYR_ID
+    _ucRegs[0x3b] = 0x80; // UNIT_SEL
+    _ucRegs[0x3d] = 0x1c; // OPR_MODE: CONFIG (upper bits read back as set)
+    _ucMode = _ucNextMode = BNO055_MODE_CONFIG;
+    _u64Switch = 0;
+    _u64Delay[SIM_DELAY_RESET] = 19 * SIM_MS;
+    _u64Delay[SIM_DELAY_POWERUP] = 7 * SIM_MS;
+} /* SimBNO055() */
+
+void SimBNO055::tick(void)
+{
+    if (_u64Switch != 0 && _u64Now >= _u64Switch) {
+        _ucMode = _ucNextMode;
+        if (_ucMode == BNO055_MODE_CONFIG) _ucRegs[0x39] = 0; // SYS_STATUS: idle
+        else if (_ucMode >= BNO055_MODE_IMU) _ucRegs[0x39] = 5; // fusion running
+        else _ucRegs[0x39] = 6; // running without fusion
+        _u64Switch = 0;
+    }
+} /* tick() */
+
+void SimBNO055::writeReg(uint8_t ucReg, uint8_t ucVal)
+{
+    if (ucReg == 0x3d && (ucVal & 0x0f) != _ucNextMode) { // OPR_MODE
+        _ucNextMode = ucVal & 0x0f;
+        _u64Switch = after((_ucNextMode == BNO055_MODE_CONFIG) ? SIM_DELAY_RESET : SIM_DELAY_POWERUP);
+    }
+    if (ucReg > 0x07 && ucReg < 0x3b) return; // read-only (data and status)
+    _ucRegs[ucReg] = ucVal;
+} /* writeReg() */
+
+void SimBNO055::sample(const SIM_MOTION *pMotion)
+{
+// sensors used by each operating mode: acc (1), mag (2), gyro (4)
+static const uint8_t ucSensors[13] = {0, 1, 2, 4, 3, 5, 6, 7, 5, 3, 3, 7, 7};
+const float *q = pMotion->fQuat;
+float fGravity[3], fEuler[3];
+int i;
+
+    if (ucSensors[_ucMode] & 1) {
+        for (i=0; i<3; i++) put16(0x08 + i*2, lsb(pMotion->fAcc[i] * SIM_G, 100.0f), false); // ACC_DATA_X_LSB
+    }
+    if (ucSensors[_ucMode] & 2) {
+        for (i=0; i<3; i++) put16(0x0e + i*2, lsb(pMotion->fMag[i], 16.0f), false); // MAG_DATA_X_LSB
+    }
+    if (ucSensors[_ucMode] & 4) {
+        for (i=0; i<3; i++) put16(0x14 + i*2, lsb(pMotion->fGyro[i], 16.0f), false); // GYR_DATA_X_LSB
+    }
+    _ucRegs[0x34] = (uint8_t)SIM_TEMP; // TEMP
+    if (_ucMode < BNO055_MODE_IMU) return;
+    // gravity in the sensor frame and the Euler angles of the orientation
+    fGravity[0] = 2.0f * (q[1]*q[3] - q[0]*q[2]);
+    fGravity[1] = 2.0f * (q[2]*q[3] + q[0]*q[1]);
+    fGravity[2] = q[0]*q[0] - q[1]*q[1] - q[2]*q[2] + q[3]*q[3];
+    fEuler[0] = atan2f(2.0f * (q[0]*q[3] + q[1]*q[2]), 1.0f - 2.0f * (q[2]*q[2] + q[3]*q[3])) * 180.0f / (float)M_PI;
+    if (fEuler[0] < 0.0f) fEuler[0] += 360.0f; // heading 0-360
+    fEuler[1] = atan2f(2.0f * (q[0]*q[1] + q[2]*q[3]), 1.0f - 2.0f * (q[1]*q[1] + q[2]*q[2])) * 180.0f / (float)M_PI;
+    fEuler[2] = asinf(fmaxf(-1.0f, fminf(1.0f, 2.0f * (q[0]*q[2] - q[3]*q[1])))) * 180.0f / (float)M_PI;
+    for (i=0; i<3; i++) {
+        put16(0x1a + i*2, lsb(fEuler[i], 16.0f), false); // EUL_Heading_LSB
+        put16(0x28 + i*2, lsb((pMotion->fAcc[i] - fGravity[i]) * SIM_G, 100.0f), false); // LIA_Data_X_LSB
+        put16(0x2e + i*2, lsb(fGravity[i] * SIM_G, 100.0f), false); // GRV_Data_X_LSB
+    }
+    for (i=0; i<4; i++) {
+        put16(0x20 + i*2, lsb(q[i], 16384.0f), false); // QUA_Data_w_LSB
+    }
+    _ucRegs[0x35] = 0xff; // CALIB_STAT: fully calibrated
+} /* sample() */
+
+//
+// Create the register model of a chip type (u8Addr = 0xff for its
+// default address)
+//
+SimChip *simCreateChip(int iType, uint8_t u8Addr)
+{
+    switch (iType) {
+        case IMU_TYPE_MPU6050:
+        case IMU_TYPE_MPU6500:
+        case IMU_TYPE_MPU6886:
+            return new SimMPU(iType, (u8Addr == 0xff) ? IMU_MPU6050_ADDR : u8Addr);
+        case IMU_TYPE_ADXL345:
+            return new SimADXL345((u8Addr == 0xff) ? IMU_ADXL345_ADDR : u8Addr);
+        case IMU_TYPE_LIS3DH:
+            return new SimLIS3D(false, (u8Addr == 0xff) ? IMU_LIS3DH_ADDR : u8Addr);
+        case IMU_TYPE_LIS3DSH:
+            return new SimLIS3D(true, (u8Addr == 0xff) ? IMU_LIS3DSH_ADDR : u8Addr);
+        case IMU_TYPE_LSM6DS3:
+            return new SimLSM6DS3((u8Addr == 0xff) ? IMU_LSM6DS3_ADDR : u8Addr);
+        case IMU_TYPE_LSM9DS1:
+            return new SimLSM9DS1((u8Addr == 0xff) ? IMU_LSM9DS1_ADDR : u8Addr);
+        case SIM_TYPE_LSM9DS1_MAG:
+            return new SimLSM9DS1Mag((u8Addr == 0xff) ? 0x1c : u8Addr);
+        case IMU_TYPE_BMI160:
+            return new SimBMI(false, (u8Addr == 0xff) ? IMU_BMI160_ADDR : u8Addr);
+        case IMU_TYPE_BMI270:
+            return new SimBMI(true, (u8Addr == 0xff) ? IMU_BMI270_ADDR : u8Addr);
+        case IMU_TYPE_QMI8658:
+            return new SimQMI8658((u8Addr == 0xff) ? IMU_QMI8658_ADDR : u8Addr);
+        case IMU_TYPE_BNO055:
+            return new SimBNO055((u8Addr == 0xff) ? IMU_BNO055_ADDR : u8Addr);
+    }
+    return NULL;
+} /* simCreateChip() */
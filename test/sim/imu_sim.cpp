@@ -0,0 +1,341 @@
+// imu_sim.cpp
+// Simulated I2C bus and clock for host builds of bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "imu_sim.h"
+#include <math.h>
+#include <mutex>
+
+typedef struct _tagsimbus
+{
+   uint32_t u32Speed;
+   int iChips;
+   SimChip *pChips[SIM_MAX_CHIPS];
+   SIM_BUS_STATS stats;
+} SIM_BUS;
+
+static SIM_BUS _buses[SIM_MAX_BUSES];
+static uint64_t _u64Now; // simulated time in ns
+static SIM_MOTION_FN _pfnMotion;
+// The ring test services the bus from a second thread
+static std::recursive_mutex _mutex;
+
+//
+// Still and level: 1g on +Z, no rotation, a field pointing north and down
+//
+static void simStill(uint64_t, SIM_MOTION *pMotion)
+{
+    memset(pMotion, 0, sizeof(SIM_MOTION));
+    pMotion->fAcc[2] = 1.0f;
+    pMotion->fMag[0] = 20.0f;
+    pMotion->fMag[2] = -40.0f;
+    pMotion->fQuat[0] = 1.0f;
+} /* simStill() */
+
+SimChip::SimChip(uint8_t u8Addr)
+{
+    _u8Addr = u8Addr;
+    memset(_ucRegs, 0, sizeof(_ucRegs));
+    _u64Now = _u64Next = _u64Period = _u64Ready = 0;
+    memset(_u64Delay, 0, sizeof(_u64Delay));
+    _u32Count = 0;
+} /* SimChip() */
+
+//
+// End of a startup phase which begins at the current time
+//
+uint64_t SimChip::after(int iPhase)
+{
+    if (_u64Delay[iPhase] == SIM_NEVER) return SIM_NEVER;
+    return _u64Now + _u64Delay[iPhase];
+} /* after() */
+
+//
+// Produce every sample which fell due up to u64Now. Samples sit on a grid
+// of whole periods from time 0, like the chips which derive their output
+// data rate from a free running counter. After the sensors are switched
+// on or change rate, the next sample waits for the SIM_DELAY_DATA
+// settling time.
+//
+void SimChip::advance(uint64_t u64Now)
+{
+SIM_MOTION motion;
+uint64_t p, u64Start;
+
+    for (;;) {
+        p = period();
+        if (p != _u64Period) { // rate changed or sensor switched on/off
+            _u64Ready = after(SIM_DELAY_DATA);
+            _u64Period = p;
+            u64Start = (_u64Ready > _u64Now) ? _u64Ready : _u64Now;
+            if (p == 0) _u64Next = 0;
+            else if (u64Start == SIM_NEVER) _u64Next = SIM_NEVER;
+            else _u64Next = ((u64Start / p) + 1) * p;
+        }
+        if (p == 0 || _u64Next > u64Now) break;
+        _u64Now = _u64Next;
+        tick();
+        if (period() != p) continue; // changed state at this point
+        simGetMotion(_u64Now, &motion);
+        sample(&motion);
+        _u32Count++;
+        _u64Next += p;
+    }
+    _u64Now = u64Now;
+    tick();
+} /* advance() */
+
+//
+// Register reads auto-increment through nextReg()
+// Returns 1 (ACK) or 0 (NACK)
+//
+int SimChip::readRegs(uint8_t ucReg, uint8_t *pData, int iLen)
+{
+int i;
+
+    for (i=0; i<iLen; i++) {
+        pData[i] = readReg(ucReg);
+        ucReg = nextReg(ucReg);
+    }
+    return 1;
+} /* readRegs() */
+
+int SimChip::writeRegs(uint8_t ucReg, const uint8_t *pData, int iLen)
+{
+int i;
+
+    for (i=0; i<iLen; i++) {
+        writeReg(ucReg, pData[i]);
+        ucReg = nextReg(ucReg);
+    }
+    return 1;
+} /* writeRegs() */
+
+//
+// Convert a physical value to the nearest LSB with +/-1 LSB of dither,
+// so that consecutive samples differ like real sensor data does
+//
+int16_t SimChip::lsb(float f, float fPerUnit)
+{
+float fVal;
+
+    fVal = f * fPerUnit + (float)((int)(_u32Count % 3) - 1);
+    fVal = floorf(fVal + 0.5f);
+    if (fVal > 32767.0f) fVal = 32767.0f;
+    else if (fVal < -32768.0f) fVal = -32768.0f;
+    return (int16_t)fVal;
+} /* lsb() */
+
+void SimChip::put16(uint8_t ucReg, int16_t i, bool bBigEndian)
+{
+    _ucRegs[ucReg] = (uint8_t)((bBigEndian) ? (i >> 8) : i);
+    _ucRegs[(uint8_t)(ucReg + 1)] = (uint8_t)((bBigEndian) ? i : (i >> 8));
+} /* put16() */
+
+//
+// Remove every chip and start over at time 0
+//
+void simReset(void)
+{
+int i, j;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    for (i=0; i<SIM_MAX_BUSES; i++) {
+        for (j=0; j<_buses[i].iChips; j++) {
+            delete _buses[i].pChips[j];
+        }
+    }
+    memset(_buses, 0, sizeof(_buses));
+    _u64Now = 0;
+    _pfnMotion = NULL;
+} /* simReset() */
+
+//
+// Put a register model of chip iType on bus iBus
+// (iAddr = -1 for the default address of that chip)
+// The LSM9DS1 brings its magnetometer die along at 0x1C
+//
+SimChip *simAddChip(int iBus, int iType, int iAddr)
+{
+SIM_BUS *pBus;
+SimChip *pChip;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    if (iBus < 0 || iBus >= SIM_MAX_BUSES) return NULL;
+    pBus = &_buses[iBus];
+    if (pBus->iChips >= SIM_MAX_CHIPS - ((iType == IMU_TYPE_LSM9DS1) ? 1 : 0)) return NULL;
+    pChip = simCreateChip(iType, (uint8_t)iAddr);
+    if (pChip == NULL) return NULL;
+    pChip->advance(_u64Now);
+    pBus->pChips[pBus->iChips++] = pChip;
+    if (iType == IMU_TYPE_LSM9DS1) {
+        pBus->pChips[pBus->iChips] = simCreateChip(SIM_TYPE_LSM9DS1_MAG, 0x1c);
+        pBus->pChips[pBus->iChips++]->advance(_u64Now);
+    }
+    return pChip;
+} /* simAddChip() */
+
+void simSetMotion(SIM_MOTION_FN pfnMotion)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    _pfnMotion = pfnMotion;
+} /* simSetMotion() */
+
+void simGetMotion(uint64_t u64Ns, SIM_MOTION *pMotion)
+{
+    if (_pfnMotion) (*_pfnMotion)(u64Ns, pMotion);
+    else simStill(u64Ns, pMotion);
+} /* simGetMotion() */
+
+uint64_t simNow(void)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    return _u64Now;
+} /* simNow() */
+
+//
+// Let time pass without bus traffic
+//
+void simAdvance(uint64_t u64Ns)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    _u64Now += u64Ns;
+} /* simAdvance() */
+
+void simGetStats(int iBus, SIM_BUS_STATS *pStats)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    memcpy(pStats, &_buses[iBus].stats, sizeof(SIM_BUS_STATS));
+} /* simGetStats() */
+
+void simResetStats(void)
+{
+int i;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    for (i=0; i<SIM_MAX_BUSES; i++) {
+        memset(&_buses[i].stats, 0, sizeof(SIM_BUS_STATS));
+    }
+} /* simResetStats() */
+
+//
+// Find the bus selected by the pins given to init() and bring the chips
+// on it up to date; unknown pins (e.g. the -1 defaults) select bus 0
+//
+static SIM_BUS *simBus(BBI2C *pI2C)
+{
+SIM_BUS *pBus;
+int i;
+
+    pBus = &_buses[(pI2C->iSDA < SIM_MAX_BUSES) ? pI2C->iSDA : 0];
+    for (i=0; i<pBus->iChips; i++) {
+        pBus->pChips[i]->advance(_u64Now);
+    }
+    return pBus;
+} /* simBus() */
+
+static SimChip *simFind(SIM_BUS *pBus, uint8_t iAddr)
+{
+int i;
+
+    for (i=0; i<pBus->iChips; i++) {
+        if (pBus->pChips[i]->addr() == iAddr) return pBus->pChips[i];
+    }
+    return NULL;
+} /* simFind() */
+
+//
+// Account for a transaction and move the clock past it
+//
+static void simCharge(SIM_BUS *pBus, int iBits, int iBytes)
+{
+uint64_t u64Ns;
+
+    u64Ns = ((uint64_t)iBits * 1000000000ULL) / ((pBus->u32Speed) ? pBus->u32Speed : 100000);
+    pBus->stats.u32Transactions++;
+    pBus->stats.u32Bytes += iBytes;
+    pBus->stats.u64BusNs += u64Ns;
+    _u64Now += u64Ns;
+} /* simCharge() */
+
+//
+// The bb_imu_host.h interface
+//
+void I2CInit(BBI2C *pI2C, uint32_t iClock)
+{
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    simBus(pI2C)->u32Speed = iClock;
+} /* I2CInit() */
+
+uint8_t I2CTest(BBI2C *pI2C, uint8_t addr)
+{
+SIM_BUS *pBus;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    pBus = simBus(pI2C);
+    simCharge(pBus, SIM_TEST_BITS, 1);
+    return (simFind(pBus, addr) != NULL);
+} /* I2CTest() */
+
+int I2CWrite(BBI2C *pI2C, uint8_t iAddr, uint8_t *pData, int iLen)
+{
+SIM_BUS *pBus;
+SimChip *pChip;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    pBus = simBus(pI2C);
+    pChip = simFind(pBus, iAddr);
+    simCharge(pBus, SIM_WRITE_OVERHEAD + iLen * 9, 1 + iLen);
+    if (pChip == NULL || iLen < 1) return 0;
+    return pChip->writeRegs(pData[0], &pData[1], iLen - 1);
+} /* I2CWrite() */
+
+int I2CReadRegister(BBI2C *pI2C, uint8_t iAddr, uint8_t u8Register, uint8_t *pData, int iLen)
+{
+SIM_BUS *pBus;
+SimChip *pChip;
+
+    std::lock_guard<std::recursive_mutex> lock(_mutex);
+    pBus = simBus(pI2C);
+    pChip = simFind(pBus, iAddr);
+    simCharge(pBus, SIM_READ_OVERHEAD + iLen * 9, 3 + iLen);
+    if (pChip == NULL) return 0;
+    return pChip->readRegs(u8Register, pData, iLen);
+} /* I2CReadRegister() */
+
+unsigned long millis(void)
+{
+    return (unsigned long)(simNow() / 1000000);
+} /* millis() */
+
+unsigned long micros(void)
+{
+    return (unsigned long)(uint32_t)(simNow() / 1000); // wraps like the Arduino one
+} /* micros() */
+
+void delay(unsigned long ulMs)
+{
+    simAdvance((uint64_t)ulMs * 1000000);
+} /* delay() */
+
+void delayMicroseconds(unsigned int uiUs)
+{
+    simAdvance((uint64_t)uiUs * 1000);
+} /* delayMicroseconds() */
@@ -0,0 +1,122 @@
+// imu_sim.h
+// Simulated I2C bus and IMU register models for host builds of bb_imu
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef __IMU_SIM__
+#define __IMU_SIM__
+//
+// Implements the functions declared in bb_imu_host.h with a simulated
+// bus. Every transaction advances a simulated clock by the time it takes
+// on the wire at the speed given to I2CInit(), and millis()/micros()/
+// delay() run on that clock, so everything the library measures is
+// deterministic. The register models answer the way the library talks
+// to each chip: ID registers, reset and power-up handshakes, output data
+// rates decoded from the rate registers, data-ready bits and FIFOs.
+// The pins given to init() (iSDA) select one of SIM_MAX_BUSES buses.
+//
+#include "bb_imu.h"
+
+#define SIM_MAX_BUSES 4
+#define SIM_MAX_CHIPS 4 // per bus
+// Bits on the wire besides the data (9 bits per byte with the ACK)
+#define SIM_READ_OVERHEAD 38 // start, address, register, restart, address, stop
+#define SIM_WRITE_OVERHEAD 11 // start, address, stop
+#define SIM_TEST_BITS 11 // start, address, stop
+// Chip types besides IMU_TYPE_xxx for simCreateChip()
+#define SIM_TYPE_LSM9DS1_MAG (-IMU_TYPE_LSM9DS1) // magnetometer die of the LSM9DS1
+
+// Startup phases whose length SimChip::setDelay() changes; the defaults
+// are the datasheet times each model uses (0 where it has no such phase)
+enum {
+   SIM_DELAY_RESET=0, // MPU6886 DEVICE_RESET, BMI270 config init, BNO055 switch to CONFIG
+   SIM_DELAY_POWERUP, // BMI160 gyro power-up, BNO055 switch to a running mode
+   SIM_DELAY_DATA, // from switching the sensors on or changing their rate to the next sample
+   SIM_DELAY_COUNT
+};
+#define SIM_NEVER UINT64_MAX // the handshake or data-ready bit never flips
+
+// Traffic seen by one bus (same byte accounting as BB_IMU_STATS)
+typedef struct _tagsimbusstats
+{
+   uint32_t u32Transactions;
+   uint32_t u32Bytes; // addresses, registers and data
+   uint64_t u64BusNs; // time the bus was busy
+} SIM_BUS_STATS;
+
+// What the simulated sensors experience at a point in time
+typedef struct _tagsimmotion
+{
+   float fAcc[3]; // g, in the accel/gyro axes
+   float fGyro[3]; // degrees per second
+   float fMag[3]; // uT
+   float fQuat[4]; // orientation (w, x, y, z) for the fusion outputs
+} SIM_MOTION;
+typedef void (*SIM_MOTION_FN)(uint64_t u64Ns, SIM_MOTION *pMotion);
+
+//
+// Register model of one chip (one I2C address)
+// The bus calls advance() with the current time before every transaction,
+// which produces the samples that fell due since the last call.
+//
+class SimChip
+{
+public:
+    SimChip(uint8_t u8Addr);
+    virtual ~SimChip() {}
+
+    uint8_t addr(void) { return _u8Addr; }
+    uint32_t samples(void) { return _u32Count; }
+    void setDelay(int iPhase, uint64_t u64Ns) { _u64Delay[iPhase] = u64Ns; }
+    uint64_t getDelay(int iPhase) { return _u64Delay[iPhase]; }
+    void advance(uint64_t u64Now);
+    virtual int readRegs(uint8_t ucReg, uint8_t *pData, int iLen);
+    virtual int writeRegs(uint8_t ucReg, const uint8_t *pData, int iLen);
+
+protected:
+    virtual uint8_t readReg(uint8_t ucReg) { return _ucRegs[ucReg]; }
+    virtual void writeReg(uint8_t ucReg, uint8_t ucVal) { _ucRegs[ucReg] = ucVal; }
+    virtual uint8_t nextReg(uint8_t ucReg) { return ucReg + 1; }
+    virtual uint64_t period(void) = 0; // ns between samples, 0 = not sampling
+    virtual void sample(const SIM_MOTION *pMotion) = 0; // latch a new sample
+    virtual void tick(void) {} // apply delayed state changes due by _u64Now
+    uint64_t after(int iPhase); // time a phase starting now ends
+    int16_t lsb(float f, float fPerUnit);
+    void put16(uint8_t ucReg, int16_t i, bool bBigEndian);
+
+    uint8_t _u8Addr;
+    uint8_t _ucRegs[256];
+    uint64_t _u64Now; // time the model has been advanced to
+    uint64_t _u64Next; // time of the next sample
+    uint64_t _u64Period;
+    uint64_t _u64Ready; // no samples before this time (SIM_DELAY_DATA)
+    uint64_t _u64Delay[SIM_DELAY_COUNT];
+    uint32_t _u32Count; // samples produced
+}; // class SimChip
+
+void simReset(void);
+SimChip *simAddChip(int iBus, int iType, int iAddr = -1);
+SimChip *simCreateChip(int iType, uint8_t u8Addr);
+void simSetMotion(SIM_MOTION_FN pfnMotion);
+void simGetMotion(uint64_t u64Ns, SIM_MOTION *pMotion);
+uint64_t simNow(void);
+void simAdvance(uint64_t u64Ns);
+void simGetStats(int iBus, SIM_BUS_STATS *pStats);
+void simResetStats(void);
+#endif // __IMU_SIM__
@@ -0,0 +1,388 @@
+// smoke_test.cpp
+// Bring up every supported IMU on the simulated bus and check what it reads
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <math.h>
+#include "imu_sim.h"
+
+static const char *szNames[] = {"", "ADXL345", "MPU6050", "LSM9DS1", "LSM6DS3", "BMI160",
+    "LIS3DH", "LIS3DSH", "MPU6886", "BNO055", "BMI270", "QMI8658", "MPU6500"};
+static int iFailures;
+#define STARTUP_RATE 200
+#define STARTUP_EXTRA (10 * 1000000ULL) // ns added to a startup phase
+
+//
+// Tilted and turning at a constant rate
+//
+static void simTilted(uint64_t, SIM_MOTION *pMotion)
+{
+    memset(pMotion, 0, sizeof(SIM_MOTION));
+    pMotion->fAcc[0] = 0.2f; pMotion->fAcc[1] = -0.3f; pMotion->fAcc[2] = 0.93f;
+    pMotion->fGyro[0] = 10.0f; pMotion->fGyro[1] = -20.0f; pMotion->fGyro[2] = 30.0f;
+    pMotion->fMag[0] = 20.0f; pMotion->fMag[2] = -40.0f;
+    pMotion->fQuat[0] = 1.0f;
+} /* simTilted() */
+
+static void check(bool bOK, int iType, const char *szWhat)
+{
+    if (!bOK) {
+        printf("FAIL %s: %s\n", szNames[iType], szWhat);
+        iFailures++;
+    }
+} /* check() */
+
+//
+// Compare the values of a sample with the simulated motion
+// (within 2% of the value plus a few LSBs for the dither)
+//
+static bool near3(const int16_t *pValues, float fScale, const float *pExpected)
+{
+float f;
+int i;
+
+    for (i=0; i<3; i++) {
+        f = (float)pValues[i] * fScale;
+        if (fabsf(f - pExpected[i]) > fabsf(pExpected[i]) * 0.02f + 4.0f * fScale) return false;
+    }
+    return true;
+} /* near3() */
+
+//
+// Detect the chip, start it and read a sample through the output registers
+//
+static void testType(int iType)
+{
+BBIMU imu;
+IMU_SAMPLE sample;
+IMU_STARTUP_INFO info;
+IMU_FRAME_FORMAT fmt;
+SIM_MOTION motion;
+int16_t i16Values[3];
+int i, iMode;
+
+    simReset();
+    simSetMotion(simTilted);
+    simAddChip(0, iType);
+    simGetMotion(0, &motion);
+    if (imu.init() != IMU_SUCCESS) {
+        check(false, iType, "init()");
+        return;
+    }
+    check(imu.type() == iType, iType, "type()");
+    iMode = MODE_ACCEL | MODE_GYRO | MODE_TEMP;
+    if (iType == IMU_TYPE_BNO055) iMode |= MODE_MAG;
+    check(imu.start(200, iMode) == IMU_SUCCESS, iType, "start()");
+    imu.getStartupInfo(&info);
+    if (iType != IMU_TYPE_BNO055) { // has no data-ready bits to wait for
+        check(info.u32FirstData != 0, iType, "no data-ready after start()");
+    }
+    simAdvance(20 * 1000000ULL);
+    memset(&sample, 0, sizeof(sample));
+    check(imu.getSample(&sample) == IMU_SUCCESS, iType, "getSample()");
+    imu.getFrameFormat(&fmt, true);
+    check(near3(sample.accel, fmt.fAccScale, motion.fAcc), iType, "accelerometer values");
+    // the LSM9DS1 driver leaves its gyroscope off
+    if ((imu.caps() & IMU_CAP_GYROSCOPE) && iType != IMU_TYPE_LSM9DS1) {
+        check(near3(sample.gyro, fmt.fGyroScale, motion.fGyro), iType, "gyroscope values");
+    }
+    for (i=0; i<3; i++) {
+        i16Values[i] = imu.getOneChannel(IMU_CHANNEL_ACC_X << i);
+    }
+    check(near3(i16Values, fmt.fAccScale, motion.fAcc), iType, "getOneChannel() accelerometer values");
+    if ((imu.caps() & IMU_CAP_GYROSCOPE) && iType != IMU_TYPE_LSM9DS1) {
+        for (i=0; i<3; i++) {
+            i16Values[i] = imu.getOneChannel(IMU_CHANNEL_GYR_X << i);
+        }
+        check(near3(i16Values, fmt.fGyroScale, motion.fGyro), iType, "getOneChannel() gyroscope values");
+    }
+} /* testType() */
+
+//
+// Read a sample at every accelerometer range and convert it with the
+// sensitivity getFrameFormat() reports for that range
+//
+static void testScales(int iType)
+{
+static const char *szScales[] = {"2g accelerometer values", "4g accelerometer values", "8g accelerometer values", "16g accelerometer values"};
+BBIMU imu;
+IMU_SAMPLE sample;
+IMU_FRAME_FORMAT fmt;
+SIM_MOTION motion;
+int iScale;
+
+    for (iScale=ACCEL_SCALE_2G; iScale<=ACCEL_SCALE_16G; iScale++) {
+        simReset();
+        simSetMotion(simTilted);
+        simAddChip(0, iType);
+        simGetMotion(0, &motion);
+        if (imu.init() != IMU_SUCCESS) return; // reported by testType()
+        imu.setAccScale(iScale);
+        if (imu.start(100, MODE_ACCEL) != IMU_SUCCESS) {
+            check(false, iType, "start()");
+            return;
+        }
+        simAdvance(20 * 1000000ULL);
+        memset(&sample, 0, sizeof(sample));
+        imu.getSample(&sample);
+        imu.getFrameFormat(&fmt, true);
+        check(near3(sample.accel, fmt.fAccScale, motion.fAcc), iType, szScales[iScale]);
+    }
+} /* testScales() */
+
+//
+// Collect 100ms of samples in the FIFO and read them as a batch
+//
+static void testFIFO(int iType)
+{
+BBIMU imu;
+IMU_SAMPLE samples[64];
+IMU_FRAME_FORMAT fmt;
+SIM_MOTION motion;
+int i, iCount;
+uint32_t u32Delta;
+
+    simReset();
+    simSetMotion(simTilted);
+    simAddChip(0, iType);
+    simGetMotion(0, &motion);
+    if (imu.init() != IMU_SUCCESS) return; // reported by testType()
+    if (imu.start(100, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS || imu.configFIFO(8) != IMU_SUCCESS) {
+        check(false, iType, "configFIFO()");
+        return;
+    }
+    simAdvance(100 * 1000000ULL);
+    iCount = imu.getSamples(samples, 64);
+    check(iCount >= 8, iType, "getSamples() returned too few samples");
+    imu.getFrameFormat(&fmt, true);
+    for (i=0; i<iCount; i++) {
+        if (!near3(samples[i].accel, fmt.fAccScale, motion.fAcc) ||
+            ((imu.caps() & IMU_CAP_GYROSCOPE) && !near3(samples[i].gyro, fmt.fGyroScale, motion.fGyro))) {
+            check(false, iType, "FIFO sample values");
+            break;
+        }
+        if (i > 0) { // 100Hz give or take the ODR rounding of the chip
+            u32Delta = samples[i].timestamp - samples[i-1].timestamp;
+            if (u32Delta < 7000 || u32Delta > 13000) {
+                check(false, iType, "FIFO sample timestamps");
+                break;
+            }
+        }
+    }
+} /* testFIFO() */
+
+//
+// configIRQ() must leave the MPU6886 aux bypass alone and only turn on
+// the LIS3DSH FIFO watermark when that interrupt is asked for
+//
+static void testIRQ(void)
+{
+BBIMU imu;
+uint8_t ucTemp[2];
+
+    simReset();
+    simAddChip(0, IMU_TYPE_MPU6886);
+    if (imu.init() != IMU_SUCCESS || imu.start(100, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS) return; // reported by testType()
+    ucTemp[0] = 0x37; // INT_PIN_CFG
+    ucTemp[1] = 0x02; // BYPASS_EN
+    I2CWrite(imu.getBB(), IMU_MPU6886_ADDR, ucTemp, 2);
+    imu.configIRQ(true, IMU_IRQ_DATA_READY, 1);
+    I2CReadRegister(imu.getBB(), IMU_MPU6886_ADDR, 0x37, ucTemp, 1);
+    check(ucTemp[0] == 0x32, IMU_TYPE_MPU6886, "configIRQ() changed INT_PIN_CFG beyond the latch bits");
+
+    simReset();
+    simAddChip(0, IMU_TYPE_LIS3DSH);
+    if (imu.init() != IMU_SUCCESS || imu.start(100, MODE_ACCEL) != IMU_SUCCESS || imu.configFIFO(0) != IMU_SUCCESS) return;
+    imu.configIRQ(true, IMU_IRQ_DATA_READY | IMU_IRQ_FIFO_FULL, 1);
+    I2CReadRegister(imu.getBB(), IMU_LIS3DSH_ADDR, 0x25, ucTemp, 1); // CTRL_REG6
+    check(ucTemp[0] == 0x52, IMU_TYPE_LIS3DSH, "configIRQ() without the watermark source");
+    imu.configIRQ(true, IMU_IRQ_FIFO_WATERMARK, 1);
+    I2CReadRegister(imu.getBB(), IMU_LIS3DSH_ADDR, 0x25, ucTemp, 1);
+    check(ucTemp[0] == 0x74, IMU_TYPE_LIS3DSH, "configIRQ() with the watermark source");
+} /* testIRQ() */
+
+//
+// Empty the BMI160/BMI270 FIFO through buffers of 1 to 3 samples; every
+// frame written must come back as a sample or be counted as lost
+//
+static void testSmallReads(int iType)
+{
+BBIMU imu;
+int16_t i16Data[3 * 6];
+IMU_FIFO_INFO info;
+SimChip *pChip;
+uint32_t u32Start, u32Frames;
+int i, iCount, iTotal;
+
+    simReset();
+    simSetMotion(simTilted);
+    pChip = simAddChip(0, iType);
+    if (imu.init() != IMU_SUCCESS) return; // reported by testType()
+    if (imu.start(100, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS || imu.configFIFO(0) != IMU_SUCCESS) {
+        check(false, iType, "configFIFO()");
+        return;
+    }
+    u32Start = pChip->samples(); // frames from here on
+    simAdvance(300 * 1000000ULL);
+    iTotal = 0;
+    for (i=0; i<1000; i++) {
+        if (imu.getQueuedSamples(i16Data, &iCount, 1 + (i % 3)) != IMU_SUCCESS) {
+            check(false, iType, "getQueuedSamples()");
+            return;
+        }
+        if (iCount == 0) break;
+        iTotal += iCount;
+    }
+    u32Frames = pChip->samples() - u32Start;
+    imu.getFIFOInfo(&info);
+    // a frame may have been written between the FIFO flush and u32Start
+    check(iTotal + info.iLost >= (int)u32Frames && iTotal + info.iLost <= (int)u32Frames + 1 && info.iLost == 0,
+          iType, "frames lost reading the FIFO in small pieces");
+} /* testSmallReads() */
+
+//
+// Start a chip with one startup phase lengthened by u64Extra (SIM_NEVER
+// for a phase which never finishes) and measure how long start() took
+// The BNO055 is started twice so that the second start() switches back
+// to CONFIG mode from a running mode.
+//
+static int startWith(int iType, int iPhase, uint64_t u64Extra, IMU_STARTUP_INFO *pInfo, uint64_t *pu64Ns)
+{
+BBIMU imu;
+SimChip *pChip;
+uint64_t u64Start;
+int rc;
+
+    simReset();
+    simSetMotion(simTilted);
+    pChip = simAddChip(0, iType);
+    if (imu.init() != IMU_SUCCESS) return IMU_ERROR;
+    if (iType == IMU_TYPE_BNO055 && imu.start(STARTUP_RATE, MODE_ACCEL | MODE_GYRO) != IMU_SUCCESS) return IMU_ERROR;
+    pChip->setDelay(iPhase, (u64Extra == SIM_NEVER) ? SIM_NEVER : pChip->getDelay(iPhase) + u64Extra);
+    u64Start = simNow();
+    rc = imu.start(STARTUP_RATE, MODE_ACCEL | MODE_GYRO);
+    *pu64Ns = simNow() - u64Start;
+    imu.getStartupInfo(pInfo);
+    return rc;
+} /* startWith() */
+
+//
+// Lengthen each startup phase the chip's model has and check that the
+// time start() reports for it follows; then make the phase never finish
+// and check that start() returns IMU_ERROR once its timeout has passed
+//
+static void testStartup(int iType)
+{
+static const char *szPhases[] = {"reset", "power-up", "first data"};
+IMU_STARTUP_INFO info, info2;
+uint64_t u64Ns, u64Ns2, u64Delay, u64Before, u64Slack;
+uint32_t u32Time, u32Time2;
+char szWhat[64];
+int iPhase;
+
+    for (iPhase=SIM_DELAY_RESET; iPhase<SIM_DELAY_COUNT; iPhase++) {
+        simReset();
+        u64Delay = simAddChip(0, iType)->getDelay(iPhase); // the modelled time
+        if (iPhase == SIM_DELAY_DATA) {
+            if (iType == IMU_TYPE_BNO055) continue; // no data-ready bits
+            u64Slack = (1000000000ULL / STARTUP_RATE) + 1000000ULL; // up to a sample period later
+        } else {
+            if (u64Delay == 0) continue; // not a phase of this chip
+            u64Slack = 1000000ULL; // polling granularity
+        }
+        if (startWith(iType, iPhase, 0, &info, &u64Ns) != IMU_SUCCESS ||
+            startWith(iType, iPhase, STARTUP_EXTRA, &info2, &u64Ns2) != IMU_SUCCESS) {
+            snprintf(szWhat, sizeof(szWhat), "start() with a longer %s", szPhases[iPhase]);
+            check(false, iType, szWhat);
+            continue;
+        }
+        u32Time = (iPhase == SIM_DELAY_RESET) ? info.u32Reset : (iPhase == SIM_DELAY_POWERUP) ? info.u32PowerUp : info.u32FirstData;
+        u32Time2 = (iPhase == SIM_DELAY_RESET) ? info2.u32Reset : (iPhase == SIM_DELAY_POWERUP) ? info2.u32PowerUp : info2.u32FirstData;
+        if (iPhase != SIM_DELAY_DATA && u32Time == 0) continue; // start() doesn't use it (MPU6050 reset)
+        snprintf(szWhat, sizeof(szWhat), "%s took %uus, %uus with %dms more", szPhases[iPhase],
+                 (unsigned)u32Time, (unsigned)u32Time2, (int)(STARTUP_EXTRA / 1000000ULL));
+        check((uint64_t)u32Time * 1000 >= u64Delay &&
+              (uint64_t)u32Time2 * 1000 + u64Slack >= (uint64_t)u32Time * 1000 + STARTUP_EXTRA &&
+              (uint64_t)u32Time2 * 1000 <= (uint64_t)u32Time * 1000 + STARTUP_EXTRA + u64Slack, iType, szWhat);
+        // the same start() without the handshake or data wait, then its timeout instead
+        u64Before = u64Ns - ((iPhase == SIM_DELAY_DATA) ? (uint64_t)u32Time * 1000 : u64Delay);
+        if (startWith(iType, iPhase, SIM_NEVER, &info2, &u64Ns2) != IMU_ERROR) {
+            snprintf(szWhat, sizeof(szWhat), "start() succeeded without a %s", szPhases[iPhase]);
+            check(false, iType, szWhat);
+        } else if (u64Ns2 > u64Before + (IMU_START_TIMEOUT + 2000 / STARTUP_RATE + 2) * 1000000ULL ||
+                   (iPhase == SIM_DELAY_DATA && u64Ns2 < u64Before + (IMU_START_TIMEOUT + 2000 / STARTUP_RATE) * 1000000ULL)) {
+            snprintf(szWhat, sizeof(szWhat), "start() without a %s failed after %dms", szPhases[iPhase], (int)((u64Ns2 - u64Before) / 1000000ULL));
+            check(false, iType, szWhat);
+        }
+    }
+} /* testStartup() */
+
+//
+// Several chips on one bus
+//
+static void testScan(void)
+{
+BBIMU imu;
+IMU_DEVICE devs[8];
+int i, iCount, iFound;
+
+    simReset();
+    simAddChip(1, IMU_TYPE_MPU6050);
+    simAddChip(1, IMU_TYPE_LIS3DH);
+    simAddChip(1, IMU_TYPE_BNO055);
+    iCount = imu.scan(devs, 8, 1, 1);
+    iFound = 0;
+    for (i=0; i<iCount; i++) {
+        if ((devs[i].u8Type == IMU_TYPE_MPU6050 && devs[i].u8Addr == IMU_MPU6050_ADDR) ||
+            (devs[i].u8Type == IMU_TYPE_LIS3DH && devs[i].u8Addr == IMU_LIS3DH_ADDR) ||
+            (devs[i].u8Type == IMU_TYPE_BNO055 && devs[i].u8Addr == IMU_BNO055_ADDR)) {
+            iFound++;
+        }
+    }
+    if (iCount != 3 || iFound != 3) {
+        printf("FAIL scan(): %d devices, %d expected ones\n", iCount, iFound);
+        iFailures++;
+    }
+} /* testScan() */
+
+int main(void)
+{
+int iType;
+
+    for (iType=IMU_TYPE_ADXL345; iType<TYPE_COUNT; iType++) {
+        testType(iType);
+        testStartup(iType);
+        if (iType != IMU_TYPE_BNO055) { // fixed range in the fusion modes
+            testScales(iType);
+        }
+        if (iType != IMU_TYPE_LSM9DS1 && iType != IMU_TYPE_BNO055) {
+            testFIFO(iType);
+        }
+        if (iType == IMU_TYPE_BMI160 || iType == IMU_TYPE_BMI270) {
+            testSmallReads(iType);
+        }
+        printf("%s done\n", szNames[iType]);
+    }
+    testScan();
+    testIRQ();
+    simReset();
+    printf("%d failures\n", iFailures);
+    return (iFailures) ? 1 : 0;
+} /* main() */
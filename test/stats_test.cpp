@@ -0,0 +1,94 @@
+// stats_test.cpp
+// Check the BB_IMU_STATS driver counters against the simulated bus
+// Written by Larry Bank
+//
+// Copyright (c) 2023 - 2025 BitBank Software, Inc.
+// All rights reserved.
+//
+// SPDX-License-Identifier: Apache-2.0
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//
+// Built against a copy of the library with BB_IMU_STATS defined
+//
+#include <stdio.h>
+#include "imu_sim.h"
+
+static const char *szNames[] = {"", "ADXL345", "MPU6050", "LSM9DS1", "LSM6DS3", "BMI160",
+    "LIS3DH", "LIS3DSH", "MPU6886", "BNO055", "BMI270", "QMI8658", "MPU6500"};
+static int iFailures;
+
+static void check(bool bOK, int iType, const char *szWhat)
+{
+    if (!bOK) {
+        printf("FAIL %s: %s\n", szNames[iType], szWhat);
+        iFailures++;
+    }
+} /* check() */
+
+//
+// Two reads with no new sample in between count one duplicate, whatever
+// else (status, temperature, sensortime) the read plan covers; a read
+// after the next sample doesn't
+//
+static void testDuplicates(int iType)
+{
+BBIMU imu;
+IMU_SAMPLE sample;
+IMU_STATS stats;
+SimChip *pChip;
+uint32_t u32Count;
+int iTries;
+
+    simReset();
+    pChip = simAddChip(0, iType);
+    if (imu.init() != IMU_SUCCESS || imu.start(100, MODE_ACCEL | MODE_GYRO | MODE_TEMP | MODE_STATUS) != IMU_SUCCESS) {
+        check(false, iType, "init()/start()");
+        return;
+    }
+    simAdvance(20 * 1000000ULL);
+    for (iTries=0; iTries<4; iTries++) { // retry if a sample landed between the two reads
+        imu.resetStats();
+        imu.getSample(&sample);
+        u32Count = pChip->samples();
+        imu.getSample(&sample);
+        if (pChip->samples() == u32Count) break;
+    }
+    imu.getStats(&stats);
+    check(stats.u32Delivered == 2 && stats.u32Duplicates == 1, iType, "repeated read not counted as a duplicate");
+    simAdvance(20 * 1000000ULL);
+    imu.getSample(&sample);
+    imu.getStats(&stats);
+    check(stats.u32Delivered == 3 && stats.u32Duplicates == 1, iType, "new sample counted as a duplicate");
+} /* testDuplicates() */
+
+int main(void)
+{
+const int iTypes[] = {IMU_TYPE_MPU6050, IMU_TYPE_LSM6DS3, IMU_TYPE_BMI160, IMU_TYPE_BMI270, IMU_TYPE_QMI8658, IMU_TYPE_LIS3DH};
+IMU_STATS stats;
+BBIMU imu;
+int i;
+
+    if (imu.getStats(&stats) != IMU_SUCCESS) {
+        printf("FAIL built without BB_IMU_STATS\n");
+        return 1;
+    }
+    for (i=0; i<(int)(sizeof(iTypes) / sizeof(iTypes[0])); i++) {
+        testDuplicates(iTypes[i]);
+        printf("%s done\n", szNames[iTypes[i]]);
+    }
+    simReset();
+    printf("%d failures\n", iFailures);
+    return (iFailures) ? 1 : 0;
+} /* main() */